@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Region allocator: objects are bump allocated from large chunks and
+// released all at once by reset() or the destructor. Destructors are never
+// run, so only trivially destructible types may be created.
+class Arena {
+private:
+    static constexpr std::size_t defaultChunkSize = 64 * 1024;
+
+    std::vector<std::unique_ptr<std::byte[]>> chunks;
+    std::vector<std::size_t> chunkSizes;
+    std::byte* cursor = nullptr;
+    std::byte* limit = nullptr;
+    std::size_t allocationCount = 0;
+
+    void grow(std::size_t size) {
+        // Chunks grow with the arena so large evaluations need few of them
+        std::size_t chunkSize = defaultChunkSize << std::min<std::size_t>(chunks.size(), 8);
+        if (chunkSize < size) {
+            chunkSize = size;
+        }
+        chunks.push_back(std::make_unique<std::byte[]>(chunkSize));
+        chunkSizes.push_back(chunkSize);
+        cursor = chunks.back().get();
+        limit = cursor + chunkSize;
+    }
+
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Allocate uninitialized memory
+    void* allocate(std::size_t size, std::size_t alignment) {
+        std::size_t padding = (alignment - reinterpret_cast<std::uintptr_t>(cursor) % alignment) % alignment;
+        if (!cursor || static_cast<std::size_t>(limit - cursor) < padding + size) {
+            grow(size + alignment);
+            padding = (alignment - reinterpret_cast<std::uintptr_t>(cursor) % alignment) % alignment;
+        }
+        void* memory = cursor + padding;
+        cursor += padding + size;
+        ++allocationCount;
+        return memory;
+    }
+
+    // Construct an object in the arena
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+        static_assert(std::is_trivially_destructible_v<T>, "Arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T{std::forward<Args>(args)...};
+    }
+
+    // Release every object, keeping the first chunk for reuse
+    void reset() {
+        if (chunks.size() > 1) {
+            chunks.resize(1);
+            chunkSizes.resize(1);
+        }
+        cursor = chunks.empty() ? nullptr : chunks.front().get();
+        limit = chunks.empty() ? nullptr : cursor + chunkSizes.front();
+        allocationCount = 0;
+    }
+
+    // Number of objects allocated since the last reset
+    std::size_t getAllocationCount() const {
+        return allocationCount;
+    }
+};
@@ -0,0 +1,147 @@
+#include "batch.h"
+#include "parser.h"
+#include "printer.h"
+#include <exception>
+
+// Expressions in flight per thread before reading waits for the oldest
+static constexpr std::size_t pendingPerThread = 4;
+
+// An expression of the script and, once done, its line of output
+struct BatchRunner::Job {
+    std::string source;
+    std::size_t generation;
+    std::string output;
+    bool failed = false;
+    std::atomic<bool> done{false};
+};
+
+// Evaluation state owned by one thread. The snapshot is copied from the
+// shared environment once and brought up to date from the log of
+// definitions, so memoized normal forms are kept per thread and the shared
+// environment is only read.
+struct BatchRunner::Worker {
+    Environment snapshot;
+    Evaluator evaluator{snapshot};
+    NodeStore store;            // Nodes of the job being run, cleared between jobs
+    bool initialized = false;
+    std::size_t generation = 0;
+};
+
+BatchRunner::BatchRunner(Environment& environment, std::size_t threadCount)
+    : environment(environment), pool(threadCount) {
+    for (std::size_t i = 0; i <= pool.getThreadCount(); ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+}
+
+BatchRunner::~BatchRunner() = default;
+
+BatchRunner::Worker& BatchRunner::currentWorker() {
+    return *workers[pool.getWorkerIndex()];
+}
+
+void BatchRunner::runJob(Job& job) {
+    Worker& worker = currentWorker();
+    if (!worker.initialized) {
+        worker.snapshot = environment;
+        worker.evaluator.setStrategy(strategy);
+        worker.evaluator.setNativeArithmetic(nativeArithmetic);
+        worker.evaluator.setTracer(tracer);
+        worker.evaluator.setLimits(limits);
+        worker.evaluator.setDefinitionStepLimit(definitionStepLimit);
+        worker.generation = job.generation;
+        worker.initialized = true;
+    }
+    // Jobs of a generation all finish before the next is submitted, so
+    // workers only ever move forwards
+    for (; worker.generation < job.generation; ++worker.generation) {
+        const auto& [name, definition] = definitions[worker.generation];
+        worker.snapshot.define(name, definition);
+    }
+    
+    // Pool tasks must not throw, so errors become the job's output
+    try {
+        // Parsed, evaluated and printed in the node store, without Expression nodes
+        worker.store.clear();
+        Parser parser(job.source, worker.snapshot);
+        NodeHandle result = worker.evaluator.evaluate(worker.store, parser.parse(worker.store));
+        job.output = PrettyPrinter().toString(worker.store, result);
+    } catch (const std::exception& e) {
+        job.output = std::string("Error: ") + e.what();
+        job.failed = true;
+    }
+    job.done = true;
+}
+
+// Write the finished jobs at the front of the queue, running queued jobs
+// on this thread until at most keep remain
+void BatchRunner::writeFinished(std::ostream& output, std::size_t keep) {
+    bool written = false;
+    while (!pending.empty()) {
+        Job& job = *pending.front();
+        if (pending.size() > keep) {
+            pool.helpUntil([&job] { return job.done.load(); });
+        } else if (!job.done) {
+            break;
+        }
+        
+        output << job.output << '\n';
+        failures += job.failed ? 1 : 0;
+        pending.pop_front();
+        written = true;
+    }
+    if (written) {
+        output.flush();
+    }
+}
+
+std::size_t BatchRunner::run(std::istream& input, std::ostream& output, std::ostream& errors) {
+    std::size_t maxPending = pendingPerThread * (pool.getThreadCount() + 1);
+    std::string line;
+    std::size_t lineNumber = 0;
+    failures = 0;
+    
+    while (std::getline(input, line)) {
+        ++lineNumber;
+        std::size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') {
+            continue;
+        }
+        if (line[start] == ':') {
+            errors << "Line " << lineNumber << ": commands are not supported in batch mode" << std::endl;
+            ++failures;
+            continue;
+        }
+        
+        try {
+            std::string name;
+            std::shared_ptr<Expression> expr;
+            Parser parser(line, environment);
+            if (parser.parseDefinition(name, expr)) {
+                // Earlier expressions must see the environment without this definition
+                writeFinished(output, 0);
+                Symbol symbol = internSymbol(name);
+                environment.define(symbol, expr);
+                definitions.emplace_back(symbol, expr);
+                continue;
+            }
+        } catch (const std::exception& e) {
+            errors << "Line " << lineNumber << ": " << e.what() << std::endl;
+            ++failures;
+            continue;
+        }
+        
+        auto job = std::make_unique<Job>();
+        job->source = line;
+        job->generation = definitions.size();
+        Job& submitted = *job;
+        pending.push_back(std::move(job));
+        pool.submit([this, &submitted] { runJob(submitted); });
+        
+        // Bounding the jobs in flight keeps long scripts in constant memory
+        writeFinished(output, maxPending);
+    }
+    
+    writeFinished(output, 0);
+    return failures;
+}
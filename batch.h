@@ -0,0 +1,77 @@
+#pragma once
+
+#include "environment.h"
+#include "evaluator.h"
+#include "reduction.h"
+#include "threadpool.h"
+#include <atomic>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Runs a script of definitions and expressions without interaction.
+// Each line is a definition (name = expression), an expression, a blank
+// line or a comment starting with '#'. Definitions are applied in order;
+// the expressions between them are independent, so they are parsed and
+// evaluated as tasks on a thread pool, each worker against its own copy
+// of the environment. A worker copies the environment once and then
+// replays the definitions of the script up to each job it runs, so it
+// keeps the normal forms it memoized that they do not invalidate.
+// Results are written in input order, one line per expression, as soon as
+// every earlier expression is done.
+class BatchRunner {
+private:
+    struct Job;
+    struct Worker;
+    
+    Environment& environment;
+    ThreadPool pool;
+    
+    // Evaluation settings every worker uses
+    Strategy strategy = Strategy::NormalOrder;
+    EvaluationLimits limits;
+    std::size_t definitionStepLimit = 10000;
+    bool nativeArithmetic = false;
+    Tracer* tracer = nullptr;
+    
+    // One worker per pool thread, plus one for the calling thread
+    std::vector<std::unique_ptr<Worker>> workers;
+    
+    // Expressions submitted but not yet written, in input order
+    std::deque<std::unique_ptr<Job>> pending;
+    
+    // Definitions made by the script so far, in order. Only appended once
+    // every job is done, so workers read it without locking. A job sees
+    // the definitions before its generation, the length of the log when it
+    // was submitted.
+    std::vector<std::pair<Symbol, std::shared_ptr<Expression>>> definitions;
+    
+    std::size_t failures = 0;
+    
+    Worker& currentWorker();
+    void runJob(Job& job);
+    void writeFinished(std::ostream& output, std::size_t keep);
+
+public:
+    // Zero threads means one per hardware thread
+    BatchRunner(Environment& environment, std::size_t threadCount);
+    ~BatchRunner();
+    
+    void setStrategy(Strategy newStrategy) { strategy = newStrategy; }
+    void setLimits(const EvaluationLimits& newLimits) { limits = newLimits; }
+    void setDefinitionStepLimit(std::size_t limit) { definitionStepLimit = limit; }
+    void setNativeArithmetic(bool enabled) { nativeArithmetic = enabled; }
+    
+    // Record the steps of every worker to one trace, which is not owned
+    void setTracer(Tracer* newTracer) { tracer = newTracer; }
+    
+    // Process every line of input. Each expression produces one line of
+    // output: its normal form, or "Error: " and the reason it has none.
+    // Errors in definitions go to errors. Returns the number of failed lines.
+    std::size_t run(std::istream& input, std::ostream& output, std::ostream& errors);
+    
+    std::size_t getThreadCount() const { return pool.getThreadCount(); }
+};
@@ -0,0 +1,316 @@
+// benchmark.cpp
+// Fixed set of workloads for the reducer and the parser. Every run uses the
+// same inputs, so results can be compared between builds. Prints a table,
+// or one JSON object per workload and line with --json.
+#include "expression.h"
+#include "evaluator.h"
+#include "parser.h"
+#include "environment.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Heap allocations made by the whole program, counted by the replacement
+// allocation functions below
+static std::atomic<std::size_t> heapAllocations{0};
+
+void* operator new(std::size_t size) {
+    ++heapAllocations;
+    if (void* memory = std::malloc(size > 0 ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+// A workload either evaluates an expression or only parses it, as
+// Expression nodes or into a NodeStore
+struct Workload {
+    std::string name;
+    std::string input;
+    bool parseOnly;
+    bool nodeStore = false;
+};
+
+// Measurements of one workload
+struct Measurement {
+    double medianMilliseconds = 0;
+    double minMilliseconds = 0;
+    std::size_t steps = 0;
+    std::size_t nodes = 0;
+    std::size_t allocations = 0;
+    std::size_t bytes = 0;
+    std::string error;
+};
+
+// Church numeral for n, written out in full
+static std::string churchNumeral(int n) {
+    std::string body = "x";
+    for (int i = 0; i < n; ++i) {
+        body = "f (" + body + ")";
+    }
+    return "\\f.\\x." + body;
+}
+
+// Prelude shared by all workloads
+static void definePrelude(Environment& env) {
+    std::vector<std::pair<std::string, std::string>> definitions = {
+        {"zero", "\\f.\\x.x"},
+        {"one", "\\f.\\x.f x"},
+        {"two", "\\f.\\x.f (f x)"},
+        {"three", "\\f.\\x.f (f (f x))"},
+        {"four", "\\f.\\x.f (f (f (f x)))"},
+        {"ten", churchNumeral(10)},
+        {"fifty", churchNumeral(50)},
+        {"hundred", churchNumeral(100)},
+        {"fivehundred", churchNumeral(500)},
+        {"succ", "\\n.\\f.\\x.f (n f x)"},
+        {"plus", "\\m.\\n.\\f.\\x.m f (n f x)"},
+        {"mult", "\\m.\\n.\\f.m (n f)"},
+        {"power", "\\m.\\n.n m"},
+        {"pred", "\\n.\\f.\\x.n (\\g.\\h.h (g f)) (\\u.x) (\\u.u)"},
+        {"iszero", "\\n.n (\\x.\\t.\\f.f) (\\t.\\f.t)"},
+        {"Y", "\\f.(\\x.f (x x)) (\\x.f (x x))"},
+        {"fact", "Y (\\f.\\n.(iszero n) one (mult n (f (pred n))))"}
+    };
+    
+    for (const auto& [name, source] : definitions) {
+        Parser parser(source, env);
+        env.define(name, parser.parse());
+    }
+}
+
+// Term nesting abstractions depth levels deep
+static std::string deepAbstraction(int depth) {
+    std::string term;
+    for (int i = 0; i < depth; ++i) {
+        term += "\\x" + std::to_string(i) + ".";
+    }
+    return term + "x0";
+}
+
+// Identity applied depth times in nested arguments
+static std::string deepApplication(int depth) {
+    std::string term = "y";
+    for (int i = 0; i < depth; ++i) {
+        term = "(\\x.x) (" + term + ")";
+    }
+    return term;
+}
+
+// Head variable applied to width arguments that each contain a redex
+static std::string wideApplication(int width) {
+    std::string term = "h";
+    for (int i = 0; i < width; ++i) {
+        term += " ((\\x.x) a" + std::to_string(i) + ")";
+    }
+    return term;
+}
+
+// Long flat input for the parser
+static std::string largeInput(int terms) {
+    std::string input = "z";
+    for (int i = 0; i < terms; ++i) {
+        input += " (\\x" + std::to_string(i % 100) + ".\\y.y x" + std::to_string(i % 100) + " plus)";
+    }
+    return input;
+}
+
+static std::vector<Workload> createWorkloads() {
+    return {
+        {"plus ten ten", "plus ten ten", false},
+        {"plus hundred hundred", "plus hundred hundred", false},
+        {"mult ten ten", "mult ten ten", false},
+        {"mult fifty fifty", "mult fifty fifty", false},
+        {"mult hundred hundred", "mult hundred hundred", false},
+        {"power two ten", "power two ten", false},
+        {"pred hundred", "pred hundred", false},
+        {"pred fivehundred", "pred fivehundred", false},
+        {"fact three", "fact three", false},
+        {"fact four", "fact four", false},
+        {"deep abstraction 2000", deepAbstraction(2000), false},
+        {"deep application 2000", deepApplication(2000), false},
+        {"wide application 5000", wideApplication(5000), false},
+        {"wide application 5000 in store", wideApplication(5000), false, true},
+        {"parse 20000 terms", largeInput(20000), true},
+        {"parse 20000 terms to store", largeInput(20000), true, true}
+    };
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Run a workload once to warm up, then repeat it and keep the median time
+static Measurement measure(const Workload& workload, Evaluator& evaluator, Environment& env, int repeat) {
+    Measurement measurement;
+    std::vector<double> times;
+    
+    try {
+        for (int run = 0; run <= repeat; ++run) {
+            std::size_t allocationsBefore = heapAllocations;
+            auto start = std::chrono::steady_clock::now();
+            
+            Parser parser(workload.input, env);
+            if (workload.nodeStore) {
+                NodeStore store;
+                NodeHandle node = parser.parse(store);
+                if (!workload.parseOnly) {
+                    start = std::chrono::steady_clock::now();
+                    allocationsBefore = heapAllocations;
+                    evaluator.evaluate(store, node);
+                }
+            } else {
+                auto expr = parser.parse();
+                if (!workload.parseOnly) {
+                    start = std::chrono::steady_clock::now();
+                    allocationsBefore = heapAllocations;
+                    evaluator.evaluate(expr);
+                }
+            }
+            
+            double elapsed = millisecondsSince(start);
+            measurement.allocations = heapAllocations - allocationsBefore;
+            if (run > 0) {
+                times.push_back(elapsed);
+            }
+        }
+    } catch (const std::exception& e) {
+        measurement.error = e.what();
+        return measurement;
+    }
+    
+    std::sort(times.begin(), times.end());
+    measurement.medianMilliseconds = times[times.size() / 2];
+    measurement.minMilliseconds = times.front();
+    if (workload.parseOnly) {
+        measurement.bytes = workload.input.size();
+    } else {
+        measurement.steps = evaluator.getStepCount();
+        measurement.nodes = evaluator.getStats().nodesAllocated;
+    }
+    return measurement;
+}
+
+// Escape a string for a JSON literal
+static std::string jsonString(const std::string& text) {
+    std::string escaped = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+
+static void printUsage() {
+    std::cerr << "Usage: lambda_bench [--json] [--repeat N] [--strategy NAME] [--native] [--filter TEXT]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    bool json = false;
+    int repeat = 5;
+    Strategy strategy = Strategy::NormalOrder;
+    bool native = false;
+    std::string filter;
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        
+        if (argument == "--json") {
+            json = true;
+        } else if (argument == "--repeat" && hasValue) {
+            repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (argument == "--strategy" && hasValue) {
+            if (!parseStrategy(argv[++i], strategy)) {
+                std::cerr << "Unknown strategy '" << argv[i] << "'" << std::endl;
+                return 1;
+            }
+        } else if (argument == "--native") {
+            native = true;
+        } else if (argument == "--filter" && hasValue) {
+            filter = argv[++i];
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+    
+    Environment env;
+    definePrelude(env);
+    Evaluator evaluator(env);
+    evaluator.setStrategy(strategy);
+    evaluator.setNativeArithmetic(native);
+    
+    if (!json) {
+        std::cout << std::left << std::setw(32) << "workload" << std::right
+                  << std::setw(12) << "median ms" << std::setw(12) << "min ms"
+                  << std::setw(10) << "steps" << std::setw(14) << "steps/s"
+                  << std::setw(10) << "nodes" << std::setw(10) << "allocs" << std::endl;
+    }
+    
+    bool failed = false;
+    for (const auto& workload : createWorkloads()) {
+        if (!filter.empty() && workload.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        
+        Measurement m = measure(workload, evaluator, env, repeat);
+        double seconds = m.medianMilliseconds / 1000.0;
+        double stepsPerSecond = seconds > 0 ? m.steps / seconds : 0;
+        double bytesPerSecond = seconds > 0 ? m.bytes / seconds : 0;
+        failed = failed || !m.error.empty();
+        
+        if (json) {
+            std::ostringstream line;
+            line << std::fixed << std::setprecision(3)
+                 << "{\"workload\":" << jsonString(workload.name)
+                 << ",\"strategy\":" << jsonString(getStrategyName(strategy))
+                 << ",\"native\":" << (native ? "true" : "false")
+                 << ",\"repeat\":" << repeat
+                 << ",\"median_ms\":" << m.medianMilliseconds
+                 << ",\"min_ms\":" << m.minMilliseconds
+                 << ",\"steps\":" << m.steps
+                 << ",\"steps_per_sec\":" << stepsPerSecond
+                 << ",\"nodes\":" << m.nodes
+                 << ",\"allocations\":" << m.allocations
+                 << ",\"bytes\":" << m.bytes
+                 << ",\"bytes_per_sec\":" << bytesPerSecond;
+            if (!m.error.empty()) {
+                line << ",\"error\":" << jsonString(m.error);
+            }
+            line << "}";
+            std::cout << line.str() << std::endl;
+        } else if (!m.error.empty()) {
+            std::cout << std::left << std::setw(32) << workload.name << "error: " << m.error << std::endl;
+        } else {
+            std::cout << std::left << std::setw(32) << workload.name << std::right << std::fixed
+                      << std::setprecision(3) << std::setw(12) << m.medianMilliseconds
+                      << std::setw(12) << m.minMilliseconds << std::setw(10) << m.steps
+                      << std::setprecision(0) << std::setw(14) << stepsPerSecond
+                      << std::setw(10) << m.nodes << std::setw(10) << m.allocations;
+            if (m.bytes > 0) {
+                std::cout << std::setprecision(1) << "  " << bytesPerSecond / 1e6 << " MB/s";
+            }
+            std::cout << std::endl;
+        }
+    }
+    
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,220 @@
+#include "bytecode.h"
+#include "evaluator.h"
+#include "native.h"
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+// Operands and entries are 32 bits wide
+static constexpr std::size_t maxCodeSize = std::numeric_limits<std::uint32_t>::max();
+
+// Instructions of dead code below which the program is never rebuilt
+static constexpr std::size_t minDeadCode = 1 << 16;
+
+// Bound on the blocks reserved from a term's size, which saturates
+static constexpr std::size_t maxReservedBlocks = 1 << 20;
+
+// Compile a term into a block and the blocks it needs, recording the names
+// of the definitions it uses. Blocks are compiled one at a time from a
+// worklist, so deep terms do not use native stack, and a subterm occurring
+// several times is compiled once.
+std::uint32_t Program::compile(TermPtr root, std::vector<Symbol>& references) {
+    // Instruction or function whose operand or entry is the block of a term
+    struct Pending {
+        TermPtr term;
+        std::size_t target;
+        bool isFunction;
+    };
+    
+    std::vector<Pending> pending;
+    std::unordered_map<TermPtr, std::uint32_t> blocks;
+    std::unordered_map<TermPtr, std::uint32_t> compiledFunctions;
+    std::vector<TermPtr> arguments;
+    
+    // Each block or function other than the root covers at least two nodes;
+    // reserving up front saves rehashing the maps of wide terms
+    std::size_t expected = std::min<std::size_t>(root->size / 2, maxReservedBlocks);
+    blocks.reserve(expected);
+    compiledFunctions.reserve(expected);
+    
+    auto emit = [this](Opcode opcode, std::size_t operand) {
+        if (code.size() >= maxCodeSize || operand > maxCodeSize) {
+            throw EvaluationError("Program is too large for the virtual machine");
+        }
+        code.push_back(Instruction{opcode, static_cast<std::uint32_t>(operand)});
+    };
+    
+    auto function = [&](TermPtr abstraction) {
+        auto [it, inserted] = compiledFunctions.emplace(abstraction, static_cast<std::uint32_t>(functions.size()));
+        if (inserted) {
+            functions.push_back(Function{0, abstraction->name});
+            pending.push_back({abstraction->left, it->second, true});
+        }
+        return it->second;
+    };
+    
+    auto compileBlock = [&](TermPtr term) {
+        auto entry = static_cast<std::uint32_t>(code.size());
+        blocks.emplace(term, entry);
+        
+        arguments.clear();
+        for (; term->kind == TermKind::Application; term = term->left) {
+            arguments.push_back(term->right);
+        }
+        
+        // The last argument is pushed first, so the first one ends up on top
+        for (TermPtr argument : arguments) {
+            switch (argument->kind) {
+                case TermKind::Bound:
+                    emit(Opcode::PushVariable, argument->index);
+                    break;
+                case TermKind::Abstraction:
+                    emit(Opcode::PushClosure, function(argument));
+                    break;
+                case TermKind::Reference:
+                    emit(Opcode::PushGlobal, argument->name);
+                    references.push_back(argument->name);
+                    break;
+                default: {
+                    auto block = blocks.find(argument);
+                    emit(Opcode::PushThunk, block != blocks.end() ? block->second : 0);
+                    if (block == blocks.end()) {
+                        pending.push_back({argument, code.size() - 1, false});
+                    }
+                    break;
+                }
+            }
+        }
+        
+        switch (term->kind) {
+            case TermKind::Bound:
+                emit(Opcode::Access, term->index);
+                break;
+            case TermKind::Abstraction:
+                emit(Opcode::Closure, function(term));
+                break;
+            case TermKind::Reference:
+                emit(Opcode::Global, term->name);
+                references.push_back(term->name);
+                break;
+            default:
+                emit(Opcode::Free, term->name);
+                break;
+        }
+        
+        if (arguments.empty()) {
+            emit(Opcode::Return, 0);
+        } else {
+            emit(Opcode::TailApply, arguments.size());
+        }
+        return entry;
+    };
+    
+    std::uint32_t entry = compileBlock(root);
+    while (!pending.empty()) {
+        Pending next = pending.back();
+        pending.pop_back();
+        
+        auto block = blocks.find(next.term);
+        std::uint32_t target = block != blocks.end() ? block->second : compileBlock(next.term);
+        if (next.isFunction) {
+            functions[next.target].entry = target;
+        } else {
+            code[next.target].operand = target;
+        }
+    }
+    return entry;
+}
+
+void Program::compileDefinition(Environment& environment, TermArena& arena, Symbol name, const NodeCheck& check) {
+    if (name >= definitions.size()) {
+        definitions.resize(name + 1);
+    }
+    std::size_t start = code.size();
+    std::size_t startFunctions = functions.size();
+    
+    // A definition that fails to compile, for instance when a limit stops
+    // the expansion of its integers, keeps its previous code and state
+    auto source = environment.lookup(name);
+    std::uint32_t entry = 0;
+    std::vector<Symbol> references;
+    if (source) {
+        try {
+            // Integer literals stand for their Church numerals
+            TermPtr term = expandNatives(arena, toDeBruijn(arena, *source), check);
+            entry = compile(term, references);
+        } catch (...) {
+            code.resize(start);
+            functions.resize(startFunctions);
+            throw;
+        }
+    }
+    
+    Definition& definition = definitions[name];
+    deadCode += definition.codeSize;
+    definition.compiled = true;
+    definition.defined = source != nullptr;
+    definition.revision = environment.getRevision(name);
+    definition.entry = entry;
+    definition.codeSize = code.size() - start;
+    definition.references = std::move(references);
+}
+
+std::uint32_t Program::compileExpression(Environment& environment, TermArena& arena, TermPtr term,
+                                         const NodeCheck& check) {
+    code.resize(expressionCode);
+    functions.resize(expressionFunctions);
+    if (deadCode > minDeadCode && deadCode > code.size() - deadCode) {
+        code.clear();
+        functions.clear();
+        definitions.clear();
+        deadCode = 0;
+    }
+    
+    // Compile the expression first: compiling it finds the definitions it uses
+    std::vector<Symbol> names;
+    std::uint32_t entry = compile(term, names);
+    std::size_t endCode = code.size();
+    
+    // Code of definitions compiled after the expression must outlive it, so
+    // the expression's code is left in place as dead code
+    auto keepDefinitions = [&]() {
+        if (code.size() != endCode) {
+            deadCode += endCode - expressionCode;
+            expressionCode = code.size();
+            expressionFunctions = functions.size();
+        }
+    };
+    
+    // Compile the definitions it uses, directly or through other definitions,
+    // that are new or were redefined; the code stays until they change
+    std::unordered_set<Symbol> seen;
+    try {
+        while (!names.empty()) {
+            Symbol name = names.back();
+            names.pop_back();
+            if (!seen.insert(name).second) {
+                continue;
+            }
+            if (name >= definitions.size() || !definitions[name].compiled
+                || definitions[name].revision != environment.getRevision(name)) {
+                compileDefinition(environment, arena, name, check);
+            }
+            names.insert(names.end(), definitions[name].references.begin(), definitions[name].references.end());
+        }
+    } catch (...) {
+        keepDefinitions();
+        throw;
+    }
+    keepDefinitions();
+    return entry;
+}
+
+bool Program::getDefinition(Symbol name, std::uint32_t& entry) const {
+    if (name >= definitions.size() || !definitions[name].defined) {
+        return false;
+    }
+    entry = definitions[name].entry;
+    return true;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "debruijn.h"
+#include "environment.h"
+#include "native.h"
+#include <cstdint>
+#include <vector>
+
+// Instructions of the bytecode virtual machine. Code is divided into blocks,
+// one for the body of each abstraction and one for each argument that needs
+// a thunk. A block evaluates one application spine: it pushes the arguments,
+// last argument first, loads the head and ends with TailApply, or with
+// Return if there are no arguments.
+enum class Opcode : std::uint8_t {
+    PushVariable,   // Push the thunk bound to variable operand, unforced
+    PushThunk,      // Push a new thunk running block operand in the current scope
+    PushClosure,    // Push a thunk already holding a closure of function operand
+    PushGlobal,     // Push the thunk shared by all uses of definition operand
+    Access,         // Load the value of variable operand, forcing its thunk
+    Closure,        // Load a closure of function operand over the current scope
+    Global,         // Load the value of definition operand, forcing its thunk
+    Free,           // Load the free variable named operand
+    TailApply,      // Apply the loaded value to operand arguments, replacing this block
+    Return          // Return the loaded value to whoever forced this block
+};
+
+struct Instruction {
+    Opcode opcode;
+    std::uint32_t operand;
+};
+
+// Compiled abstraction
+struct Function {
+    std::uint32_t entry;        // Block of the body
+    Symbol hint;                // Parameter name, for printing
+};
+
+// Bytecode for the definitions of an environment and the expression being
+// evaluated. A definition is compiled the first time an expression uses it
+// and reused until it is redefined; definitions are referred to by name, so
+// redefining one never invalidates the code of the others. The code of an
+// expression is discarded when the next expression is compiled. The old
+// code of redefined definitions stays in place until it outweighs the live
+// code; then the program is emptied, and definitions are compiled again as
+// expressions use them.
+//
+// Compiling pays off for definitions that are used again and again. A large
+// literal expression is compiled only to run once, so the tree reducers
+// normalize it faster.
+class Program {
+private:
+    struct Definition {
+        bool compiled = false;
+        bool defined = false;               // False if the name was undefined when compiled
+        std::size_t revision = 0;           // Environment revision of the definition compiled
+        std::uint32_t entry = 0;
+        std::size_t codeSize = 0;           // Instructions of its blocks
+        std::vector<Symbol> references;
+    };
+    
+    std::vector<Instruction> code;
+    std::vector<Function> functions;
+    std::vector<Definition> definitions;
+    
+    // Instructions of definitions that were compiled again since
+    std::size_t deadCode = 0;
+    
+    // Sizes of code and functions before the current expression was compiled
+    std::size_t expressionCode = 0;
+    std::size_t expressionFunctions = 0;
+    
+    std::uint32_t compile(TermPtr term, std::vector<Symbol>& references);
+    void compileDefinition(Environment& environment, TermArena& arena, Symbol name, const NodeCheck& check);
+
+public:
+    // Compile an expression, and the definitions it uses that have not been
+    // compiled in their current form, replacing the previous expression.
+    // The integers of definitions are expanded under check. Returns the
+    // entry of the expression's block.
+    std::uint32_t compileExpression(Environment& environment, TermArena& arena, TermPtr term,
+                                    const NodeCheck& check = nullptr);
+    
+    const Instruction* getCode() const { return code.data(); }
+    const Function& getFunction(std::uint32_t index) const { return functions[index]; }
+    
+    // Entry of a definition used by the current expression; false if the name is not defined
+    bool getDefinition(Symbol name, std::uint32_t& entry) const;
+    
+    // Number of instructions, including those of the current expression
+    std::size_t getCodeSize() const { return code.size(); }
+};
@@ -0,0 +1,184 @@
+#include "cek.h"
+#include "arena.h"
+#include <vector>
+
+namespace {
+
+struct Binding;
+
+enum class ValueKind {
+    Closure,        // Lambda with its environment
+    Variable,       // Variable bound by the level-th lambda entered during read back
+    Stuck,          // Free variable or undefined reference
+    Application     // Stuck value applied to a value
+};
+
+struct Value {
+    ValueKind kind;
+    TermPtr term;                   // Closure: the lambda; Stuck: the free name
+    const Binding* environment;     // Closure
+    std::size_t level;              // Variable
+    const Value* function;          // Application
+    const Value* argument;          // Application
+};
+
+// Environments are immutable linked lists, innermost binding first
+struct Binding {
+    const Value* value;
+    const Binding* next;
+};
+
+enum class FrameKind {
+    // Continuations of evaluation, receiving a value
+    EvaluateArgument,   // Evaluate the argument once the function is a value
+    ApplyFunction,      // Apply the evaluated function once the argument is a value
+    // Continuations of read back, receiving a term
+    QuoteBody,          // Wrap the read back body in a lambda
+    QuoteArgument,      // Read back the argument of a stuck application
+    BuildApplication    // Apply the read back function to the read back argument
+};
+
+struct Frame {
+    FrameKind kind;
+    TermPtr term;                   // EvaluateArgument: the argument; QuoteBody: the lambda; BuildApplication: the function
+    const Binding* environment;     // EvaluateArgument
+    const Value* value;             // ApplyFunction: the function; QuoteArgument: the argument
+};
+
+const Value* lookup(const Binding* environment, std::size_t index) {
+    for (std::size_t i = 0; i < index; ++i) {
+        environment = environment->next;
+    }
+    return environment->value;
+}
+
+bool isQuoteFrame(const Frame& frame) {
+    return frame.kind == FrameKind::QuoteBody || frame.kind == FrameKind::QuoteArgument
+        || frame.kind == FrameKind::BuildApplication;
+}
+
+}
+
+TermPtr CekMachine::normalize(TermPtr start) {
+    TermArena& terms = context.getArena();
+    
+    // Values, environments and neutral terms are only needed while the machine runs
+    Arena machine;
+    MachineNodeCounter machineNodes(context);
+    
+    std::vector<Frame> stack;
+    std::size_t depth = 0;
+    
+    // Machine registers: exactly one of them is live at a time
+    TermPtr control = start;
+    const Binding* environment = nullptr;
+    const Value* value = nullptr;
+    TermPtr quoted = nullptr;
+    
+    while (true) {
+        machineNodes.update(machine.getAllocationCount() + stack.size());
+        if (control) {
+            // Evaluate the control term in the environment
+            TermPtr term = control;
+            control = nullptr;
+            
+            switch (term->kind) {
+                case TermKind::Bound:
+                    value = lookup(environment, term->index);
+                    break;
+                case TermKind::Abstraction:
+                    value = machine.create<Value>(Value{ValueKind::Closure, term, environment, 0, nullptr, nullptr});
+                    break;
+                case TermKind::Application:
+                    stack.push_back({FrameKind::EvaluateArgument, term->right, environment, nullptr});
+                    control = term->left;
+                    break;
+                case TermKind::Reference: {
+                    auto definition = context.lookupDefinition(term->name);
+                    if (definition) {
+                        context.countStep(StepKind::Delta, term->name, definition);
+                        control = definition;
+                        environment = nullptr;
+                        break;
+                    }
+                    value = machine.create<Value>(Value{ValueKind::Stuck, term, nullptr, 0, nullptr, nullptr});
+                    break;
+                }
+                default:
+                    value = machine.create<Value>(Value{ValueKind::Stuck, term, nullptr, 0, nullptr, nullptr});
+                    break;
+            }
+        } else if (value && !stack.empty() && !isQuoteFrame(stack.back())) {
+            // Pass the value to the continuation
+            Frame frame = stack.back();
+            stack.pop_back();
+            
+            if (frame.kind == FrameKind::EvaluateArgument) {
+                stack.push_back({FrameKind::ApplyFunction, nullptr, nullptr, value});
+                control = frame.term;
+                environment = frame.environment;
+                value = nullptr;
+            } else if (frame.value->kind == ValueKind::Closure) {
+                // (λ.M)[E] V -> M[V :: E]
+                context.countStep(StepKind::Beta, 0, frame.value->term);
+                control = frame.value->term->left;
+                environment = machine.create<Binding>(Binding{value, frame.value->environment});
+                value = nullptr;
+            } else {
+                value = machine.create<Value>(Value{ValueKind::Application, nullptr, nullptr, 0, frame.value, value});
+            }
+        } else if (value) {
+            // The value is final: read it back as a normal form term
+            const Value* result = value;
+            value = nullptr;
+            
+            switch (result->kind) {
+                case ValueKind::Closure: {
+                    // Evaluate the body with a fresh variable for the parameter
+                    auto variable = machine.create<Value>(Value{ValueKind::Variable, nullptr, nullptr, depth++, nullptr, nullptr});
+                    stack.push_back({FrameKind::QuoteBody, result->term, nullptr, nullptr});
+                    control = result->term->left;
+                    environment = machine.create<Binding>(Binding{variable, result->environment});
+                    break;
+                }
+                case ValueKind::Variable:
+                    // Convert the binding level back into an index
+                    quoted = terms.makeBound(depth - 1 - result->level);
+                    break;
+                case ValueKind::Stuck:
+                    quoted = result->term;
+                    break;
+                case ValueKind::Application:
+                    stack.push_back({FrameKind::QuoteArgument, nullptr, nullptr, result->argument});
+                    value = result->function;
+                    break;
+            }
+        } else {
+            // Pass the read back term to the continuation
+            if (stack.empty()) {
+                context.countMachineNodes(machine.getAllocationCount());
+                return quoted;
+            }
+            
+            Frame frame = stack.back();
+            stack.pop_back();
+            
+            switch (frame.kind) {
+                case FrameKind::QuoteBody:
+                    quoted = terms.makeAbstraction(frame.term->name, quoted);
+                    --depth;
+                    break;
+                case FrameKind::QuoteArgument:
+                    stack.push_back({FrameKind::BuildApplication, quoted, nullptr, nullptr});
+                    value = frame.value;
+                    quoted = nullptr;
+                    break;
+                case FrameKind::BuildApplication:
+                    quoted = terms.makeApplication(frame.term, quoted);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
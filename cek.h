@@ -0,0 +1,22 @@
+#pragma once
+
+#include "debruijn.h"
+#include "reduction.h"
+
+// Applicative order (call-by-value) evaluation on a CEK machine.
+// The machine state is a control term, an environment of values and a
+// continuation; environments and continuation frames are heap allocated,
+// so neither evaluation nor read back uses native stack. Every argument is
+// reduced to a value exactly once before the function is entered, which
+// avoids the repeated argument work of normal order but diverges on terms
+// that only terminate because an argument is never used.
+class CekMachine {
+private:
+    IReductionContext& context;
+
+public:
+    explicit CekMachine(IReductionContext& context) : context(context) {}
+    
+    // Reduce a closed-over term to normal form
+    TermPtr normalize(TermPtr term);
+};
@@ -0,0 +1,551 @@
+#include "debruijn.h"
+#include "visitor.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+
+// Mix a value into a hash
+static std::size_t combineHash(std::size_t seed, std::size_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+// Slot of a hash in the node table. The combined hash of a chain-shaped
+// term differs from its child's mostly in the high bits, so it is mixed
+// before masking, or linear probing clusters.
+static std::size_t getSlotHash(std::size_t hash) {
+    std::uint64_t mixed = hash;
+    mixed ^= mixed >> 33;
+    mixed *= 0xff51afd7ed558ccdULL;
+    mixed ^= mixed >> 33;
+    mixed *= 0xc4ceb9fe1a85ec53ULL;
+    mixed ^= mixed >> 33;
+    return static_cast<std::size_t>(mixed);
+}
+
+// Children and names are canonical, so nodes are compared shallowly by identity
+static bool sameNode(const Term& a, const Term& b) {
+    return a.kind == b.kind && a.index == b.index && a.name == b.name
+        && a.left == b.left && a.right == b.right;
+}
+
+// Return the canonical node equal to the candidate, creating it if needed
+TermPtr TermArena::intern(const Term& candidate) {
+    Term node = candidate;
+    std::size_t hash = combineHash(static_cast<std::size_t>(node.kind), node.index);
+    hash = combineHash(hash, node.name);
+    hash = combineHash(hash, node.left ? node.left->hash : 0);
+    hash = combineHash(hash, node.right ? node.right->hash : 0);
+    node.hash = hash;
+    
+    // Shared subterms count once per occurrence, so saturate instead of overflowing
+    std::size_t size = 1;
+    for (TermPtr child : {node.left, node.right}) {
+        if (child) {
+            size = child->size > SIZE_MAX - size ? SIZE_MAX : size + child->size;
+        }
+    }
+    node.size = size;
+    node.native = node.kind == TermKind::Integer || node.kind == TermKind::Primitive
+        || (node.left && node.left->native) || (node.right && node.right->native);
+    
+    // Free indices are what substitution and shifting can change, so
+    // subterms without any are shared unchanged
+    switch (node.kind) {
+        case TermKind::Bound:
+            node.scope = node.index + 1;
+            break;
+        case TermKind::Abstraction:
+            node.scope = node.left->scope > 0 ? node.left->scope - 1 : 0;
+            break;
+        case TermKind::Application:
+            node.scope = std::max(node.left->scope, node.right->scope);
+            break;
+        default:
+            node.scope = 0;
+            break;
+    }
+    
+    std::size_t mask = table.size() - 1;
+    for (std::size_t slot = getSlotHash(hash) & mask; ; slot = (slot + 1) & mask) {
+        if (!table[slot]) {
+            TermPtr term = arena.create<Term>(node);
+            table[slot] = term;
+            peakSize = std::max(peakSize, size);
+            if (++nodeCount * 2 > table.size()) {
+                growTable();
+            }
+            return term;
+        }
+        if (table[slot]->hash == hash && sameNode(*table[slot], node)) {
+            return table[slot];
+        }
+    }
+}
+
+void TermArena::growTable() {
+    std::vector<TermPtr> old(table.size() * 2, nullptr);
+    old.swap(table);
+    std::size_t mask = table.size() - 1;
+    for (TermPtr term : old) {
+        if (term) {
+            std::size_t slot = getSlotHash(term->hash) & mask;
+            while (table[slot]) {
+                slot = (slot + 1) & mask;
+            }
+            table[slot] = term;
+        }
+    }
+}
+
+void TermArena::reset() {
+    // Clearing a table grown by a large evaluation would cost every later small one
+    if (table.size() > initialTableSize) {
+        std::vector<TermPtr>(initialTableSize, nullptr).swap(table);
+    } else {
+        std::fill(table.begin(), table.end(), nullptr);
+    }
+    nodeCount = 0;
+    peakSize = 0;
+    arena.reset();
+}
+
+// Term constructors
+TermPtr TermArena::makeBound(std::size_t index) {
+    return intern(Term{TermKind::Bound, index, 0, false, nullptr, nullptr, 0, 0, 0});
+}
+
+TermPtr TermArena::makeFree(Symbol name) {
+    return intern(Term{TermKind::Free, 0, name, false, nullptr, nullptr, 0, 0, 0});
+}
+
+TermPtr TermArena::makeReference(Symbol name) {
+    return intern(Term{TermKind::Reference, 0, name, false, nullptr, nullptr, 0, 0, 0});
+}
+
+TermPtr TermArena::makeAbstraction(Symbol hint, TermPtr body) {
+    return intern(Term{TermKind::Abstraction, 0, hint, false, body, nullptr, 0, 0, 0});
+}
+
+TermPtr TermArena::makeApplication(TermPtr function, TermPtr argument) {
+    return intern(Term{TermKind::Application, 0, 0, false, function, argument, 0, 0, 0});
+}
+
+TermPtr TermArena::makeInteger(std::size_t value, TermPtr church) {
+    return intern(Term{TermKind::Integer, value, 0, false, church, nullptr, 0, 0, 0});
+}
+
+TermPtr TermArena::makePrimitive(std::size_t operation, TermPtr church) {
+    return intern(Term{TermKind::Primitive, operation, 0, false, church, nullptr, 0, 0, 0});
+}
+
+// Rebuild a term with every bound variable replaced by replace(variable, depth),
+// where depth is the number of abstractions entered so far. Variables with an
+// index below cutoff + depth must be left unchanged by replace, so subterms
+// whose free indices all lie below it are reused without being visited.
+// Uses an explicit stack so deep terms do not exhaust the native stack.
+template <typename Replace>
+static TermPtr mapBound(TermArena& arena, TermPtr root, std::size_t cutoff, const Replace& replace) {
+    struct Frame {
+        TermPtr term;
+        std::size_t depth;
+        bool childrenDone;
+    };
+    
+    std::vector<Frame> frames{{root, 0, false}};
+    std::vector<TermPtr> results;
+    
+    while (!frames.empty()) {
+        Frame frame = frames.back();
+        frames.pop_back();
+        TermPtr term = frame.term;
+        
+        if (!frame.childrenDone && term->scope <= cutoff + frame.depth) {
+            results.push_back(term);
+            continue;
+        }
+        
+        switch (term->kind) {
+            case TermKind::Bound:
+                results.push_back(replace(term, frame.depth));
+                break;
+            case TermKind::Abstraction:
+                if (frame.childrenDone) {
+                    results.back() = arena.makeAbstraction(term->name, results.back());
+                } else {
+                    frames.push_back({term, frame.depth, true});
+                    frames.push_back({term->left, frame.depth + 1, false});
+                }
+                break;
+            case TermKind::Application:
+                if (frame.childrenDone) {
+                    TermPtr argument = results.back();
+                    results.pop_back();
+                    results.back() = arena.makeApplication(results.back(), argument);
+                } else {
+                    // The function is popped and rebuilt first
+                    frames.push_back({term, frame.depth, true});
+                    frames.push_back({term->right, frame.depth, false});
+                    frames.push_back({term->left, frame.depth, false});
+                }
+                break;
+            default:
+                // Free variables, references and native terms contain no indices
+                results.push_back(term);
+                break;
+        }
+    }
+    
+    return results.back();
+}
+
+// Index shifting
+TermPtr shift(TermArena& arena, TermPtr term, long delta, std::size_t cutoff) {
+    return mapBound(arena, term, cutoff, [&](TermPtr variable, std::size_t depth) {
+        if (variable->index >= cutoff + depth) {
+            return arena.makeBound(static_cast<std::size_t>(static_cast<long>(variable->index) + delta));
+        }
+        return variable;
+    });
+}
+
+// Substitute argument for index 0 and drop the binder
+TermPtr instantiate(TermArena& arena, TermPtr body, TermPtr argument) {
+    // Copies of the argument shifted for each depth, as occurrences at the same depth share one
+    std::vector<TermPtr> shifted;
+    
+    return mapBound(arena, body, 0, [&](TermPtr variable, std::size_t depth) {
+        if (variable->index == depth) {
+            // The argument moves under depth abstractions; closed arguments are shared as is
+            if (depth >= shifted.size()) {
+                shifted.resize(depth + 1, nullptr);
+            }
+            if (!shifted[depth]) {
+                shifted[depth] = depth == 0 ? argument : shift(arena, argument, static_cast<long>(depth));
+            }
+            return shifted[depth];
+        }
+        if (variable->index > depth) {
+            // Variable bound outside the removed abstraction
+            return arena.makeBound(variable->index - 1);
+        }
+        return variable;
+    });
+}
+
+// Find the De Bruijn index of the innermost binder with the given name;
+// binders holds the parameters of the enclosing abstractions, innermost last
+static bool findBinder(const std::vector<Symbol>& binders, Symbol name, std::size_t& index) {
+    for (std::size_t i = binders.size(); i > 0; --i) {
+        if (binders[i - 1] == name) {
+            index = binders.size() - i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Traversal converting named expressions into nameless terms
+class DeBruijnConverter : public ITraversal {
+private:
+    TermArena& arena;
+    // Terms of the finished subexpressions whose parent is not finished yet
+    std::vector<TermPtr> results;
+    // Parameters of the enclosing abstractions, innermost last
+    std::vector<Symbol> binders;
+    
+    TermPtr pop() {
+        TermPtr term = results.back();
+        results.pop_back();
+        return term;
+    }
+
+public:
+    explicit DeBruijnConverter(TermArena& arena) : arena(arena) {}
+    
+    void visit(const Variable& variable) override {
+        std::size_t index;
+        if (findBinder(binders, variable.getSymbol(), index)) {
+            results.push_back(arena.makeBound(index));
+        } else {
+            results.push_back(arena.makeFree(variable.getSymbol()));
+        }
+    }
+    
+    bool enter(const Abstraction& abstraction) override {
+        binders.push_back(abstraction.getParameterSymbol());
+        return true;
+    }
+    
+    void leave(const Abstraction& abstraction) override {
+        binders.pop_back();
+        results.push_back(arena.makeAbstraction(abstraction.getParameterSymbol(), pop()));
+    }
+    
+    void leave(const Application&) override {
+        TermPtr argument = pop();
+        TermPtr function = pop();
+        results.push_back(arena.makeApplication(function, argument));
+    }
+    
+    void visit(const NamedReference& reference) override {
+        // A lambda parameter shadows a definition of the same name
+        std::size_t index;
+        if (findBinder(binders, reference.getSymbol(), index)) {
+            results.push_back(arena.makeBound(index));
+        } else {
+            results.push_back(arena.makeReference(reference.getSymbol()));
+        }
+    }
+    
+    void visit(const IntegerLiteral& literal) override {
+        results.push_back(arena.makeInteger(literal.getValue()));
+    }
+    
+    TermPtr convert(const Expression& expr) {
+        traverse(expr, *this);
+        return pop();
+    }
+};
+
+TermPtr toDeBruijn(TermArena& arena, const Expression& expr) {
+    DeBruijnConverter converter(arena);
+    return converter.convert(expr);
+}
+
+TermPtr toDeBruijn(TermArena& arena, const NodeStore& store, NodeHandle root) {
+    std::vector<std::pair<NodeHandle, bool>> stack{{root, false}};
+    std::vector<TermPtr> results;
+    std::vector<Symbol> binders;
+    
+    while (!stack.empty()) {
+        auto [node, childrenDone] = stack.back();
+        stack.pop_back();
+        
+        std::size_t index;
+        switch (store.getTag(node)) {
+            case NodeTag::Variable:
+                results.push_back(findBinder(binders, store.getName(node), index)
+                    ? arena.makeBound(index) : arena.makeFree(store.getName(node)));
+                break;
+            case NodeTag::Reference:
+                // A lambda parameter shadows a definition of the same name
+                results.push_back(findBinder(binders, store.getName(node), index)
+                    ? arena.makeBound(index) : arena.makeReference(store.getName(node)));
+                break;
+            case NodeTag::Integer:
+                results.push_back(arena.makeInteger(store.getValue(node)));
+                break;
+            case NodeTag::Abstraction:
+                if (!childrenDone) {
+                    binders.push_back(store.getName(node));
+                    stack.push_back({node, true});
+                    stack.push_back({store.getBody(node), false});
+                    break;
+                }
+                binders.pop_back();
+                results.back() = arena.makeAbstraction(store.getName(node), results.back());
+                break;
+            case NodeTag::Application: {
+                if (!childrenDone) {
+                    stack.push_back({node, true});
+                    stack.push_back({store.getArgument(node), false});
+                    stack.push_back({store.getFunction(node), false});
+                    break;
+                }
+                TermPtr argument = results.back();
+                results.pop_back();
+                results.back() = arena.makeApplication(results.back(), argument);
+                break;
+            }
+        }
+    }
+    return results.back();
+}
+
+// Collect the names of free variables and references, which parameters must
+// avoid. Shared subterms are visited once.
+static void collectGlobalNames(TermPtr root, std::unordered_set<std::string_view>& names) {
+    std::vector<TermPtr> pending{root};
+    std::unordered_set<TermPtr> visited;
+    while (!pending.empty()) {
+        TermPtr term = pending.back();
+        pending.pop_back();
+        switch (term->kind) {
+            case TermKind::Free:
+            case TermKind::Reference:
+                names.insert(getSymbolName(term->name));
+                break;
+            case TermKind::Abstraction:
+            case TermKind::Application:
+                if (visited.insert(term).second) {
+                    pending.push_back(term->left);
+                    if (term->right) {
+                        pending.push_back(term->right);
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Converts nameless terms back into named expressions, built by an
+// ExpressionBuilder or a NodeStore. Uses an explicit stack so deep terms do
+// not exhaust the native stack.
+template <typename Builder>
+class NameAssigner {
+private:
+    using Handle = typename Builder::Handle;
+    
+    Builder& builder;
+    const std::unordered_set<std::string_view>& globalNames;
+    // Names chosen for the enclosing abstractions, innermost last
+    std::vector<Symbol> scope;
+    std::unordered_map<std::string, int> inScope;
+    std::size_t renames = 0;
+    
+    // Lowest suffix of each base name that may be free; every lower one is
+    // in use. Deeply nested parameters with the same hint are then named
+    // in constant time instead of trying every suffix from one again.
+    std::unordered_map<std::string, int> firstFree;
+    
+    bool isUsed(const std::string& name) const {
+        auto it = inScope.find(name);
+        return globalNames.count(name) > 0 || (it != inScope.end() && it->second > 0);
+    }
+    
+    std::string chooseName(Symbol hint) {
+        std::string base = hint == 0 ? "x" : getSymbolName(hint);
+        int& suffix = firstFree[base];
+        std::string name = suffix == 0 ? base : base + std::to_string(suffix);
+        
+        while (isUsed(name)) {
+            name = base + std::to_string(++suffix);
+        }
+        if (suffix > 0) {
+            ++renames;
+        }
+        ++suffix;
+        
+        return name;
+    }
+    
+    // A parameter going out of scope frees its name for every base it can
+    // be formed from: the name itself, and each split before a number
+    void release(const std::string& name) {
+        --inScope[name];
+        for (std::size_t split = name.size(); split > 0; --split) {
+            auto base = firstFree.find(name.substr(0, split));
+            if (split == name.size() || (name[split] != '0' && name.size() - split < 10)) {
+                int suffix = split == name.size() ? 0 : std::stoi(name.substr(split));
+                if (base != firstFree.end() && base->second > suffix) {
+                    base->second = suffix;
+                }
+            }
+            if (!std::isdigit(static_cast<unsigned char>(name[split - 1]))) {
+                break;
+            }
+        }
+    }
+
+public:
+    NameAssigner(Builder& builder, const std::unordered_set<std::string_view>& globals)
+        : builder(builder), globalNames(globals) {}
+    
+    Handle convert(TermPtr root) {
+        struct Frame {
+            TermPtr term;
+            bool childrenDone;
+        };
+        
+        std::vector<Frame> stack{{root, false}};
+        std::vector<Handle> results;
+        
+        while (!stack.empty()) {
+            Frame frame = stack.back();
+            stack.pop_back();
+            TermPtr term = frame.term;
+            
+            switch (term->kind) {
+                case TermKind::Bound:
+                    results.push_back(builder.makeVariable(scope[scope.size() - 1 - term->index]));
+                    break;
+                case TermKind::Free:
+                    results.push_back(builder.makeVariable(term->name));
+                    break;
+                case TermKind::Reference:
+                    results.push_back(builder.makeReference(term->name));
+                    break;
+                case TermKind::Abstraction: {
+                    if (!frame.childrenDone) {
+                        std::string parameter = chooseName(term->name);
+                        ++inScope[parameter];
+                        scope.push_back(internSymbol(parameter));
+                        stack.push_back({term, true});
+                        stack.push_back({term->left, false});
+                        break;
+                    }
+                    Symbol parameter = scope.back();
+                    scope.pop_back();
+                    release(getSymbolName(parameter));
+                    auto body = std::move(results.back());
+                    results.pop_back();
+                    results.push_back(builder.makeAbstraction(parameter, std::move(body)));
+                    break;
+                }
+                case TermKind::Application: {
+                    if (!frame.childrenDone) {
+                        stack.push_back({term, true});
+                        stack.push_back({term->right, false});
+                        stack.push_back({term->left, false});
+                        break;
+                    }
+                    auto argument = std::move(results.back());
+                    results.pop_back();
+                    auto function = std::move(results.back());
+                    results.pop_back();
+                    results.push_back(builder.makeApplication(std::move(function), std::move(argument)));
+                    break;
+                }
+                case TermKind::Integer:
+                    if (!term->left) {
+                        results.push_back(builder.makeInteger(term->index));
+                        break;
+                    }
+                    stack.push_back({term->left, false});
+                    break;
+                case TermKind::Primitive:
+                    stack.push_back({term->left, false});
+                    break;
+            }
+        }
+        return results.back();
+    }
+    
+    // Number of parameters renamed so far
+    std::size_t getRenameCount() const { return renames; }
+};
+
+template <typename Builder>
+static typename Builder::Handle assignNames(Builder& builder, TermPtr term, std::size_t* renames) {
+    std::unordered_set<std::string_view> globalNames;
+    collectGlobalNames(term, globalNames);
+    NameAssigner<Builder> assigner(builder, globalNames);
+    auto expression = assigner.convert(term);
+    if (renames) {
+        *renames += assigner.getRenameCount();
+    }
+    return expression;
+}
+
+std::shared_ptr<Expression> fromDeBruijn(TermPtr term, std::size_t* renames) {
+    ExpressionBuilder builder;
+    return assignNames(builder, term, renames);
+}
+
+NodeHandle fromDeBruijn(NodeStore& store, TermPtr term, std::size_t* renames) {
+    return assignNames(store, term, renames);
+}
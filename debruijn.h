@@ -0,0 +1,100 @@
+#pragma once
+
+#include "expression.h"
+#include "nodestore.h"
+#include "arena.h"
+#include "symbol.h"
+#include <memory>
+#include <vector>
+
+// Kinds of nameless terms
+enum class TermKind {
+    Bound,          // Variable bound by an enclosing abstraction (De Bruijn index)
+    Free,           // Variable not bound anywhere in the term
+    Reference,      // Reference to a definition in the environment
+    Abstraction,    // λ.M
+    Application,    // M N
+    Integer,        // Native natural number, standing for its Church numeral
+    Primitive       // Native arithmetic operation, standing for its Church encoding
+};
+
+// Nameless term used internally by the evaluator.
+// Bound variables carry the number of abstractions between them and their
+// binder, so beta reduction only has to shift indices and never renames.
+// Terms live in a TermArena, are immutable once built and are hash-consed:
+// structurally identical terms are the same node, so equality is a pointer
+// comparison and repeated subterms are stored once.
+struct Term {
+    TermKind kind;
+    std::size_t index;          // Bound: De Bruijn index; Integer: the value; Primitive: the operation
+    Symbol name;                // Free/Reference: the name; Abstraction: parameter hint for printing
+    bool native;                // Whether the term contains Integer or Primitive nodes; computed when built
+    const Term* left;           // Abstraction: body; Application: function;
+                                // Integer/Primitive: Church form it replaces, null for literals
+    const Term* right;          // Application: argument
+    std::size_t hash;           // Structural hash, computed once when the node is built
+    std::size_t size;           // Number of nodes in the tree, saturating; computed when built
+    std::size_t scope;          // One more than the largest index escaping the term, 0 if closed
+};
+
+using TermPtr = const Term*;
+
+// Owns the terms built during one evaluation and frees them in bulk.
+// Every constructor returns the canonical node for its structure.
+class TermArena {
+private:
+    static constexpr std::size_t initialTableSize = 1024;
+    
+    Arena arena;
+    
+    // Open addressing table of canonical nodes
+    std::vector<TermPtr> table;
+    std::size_t nodeCount = 0;
+    std::size_t peakSize = 0;
+    
+    TermPtr intern(const Term& candidate);
+    void growTable();
+
+public:
+    TermArena() : table(initialTableSize, nullptr) {}
+    
+    // Term constructors
+    TermPtr makeBound(std::size_t index);
+    TermPtr makeFree(Symbol name);
+    TermPtr makeReference(Symbol name);
+    TermPtr makeAbstraction(Symbol hint, TermPtr body);
+    TermPtr makeApplication(TermPtr function, TermPtr argument);
+    TermPtr makeInteger(std::size_t value, TermPtr church = nullptr);
+    TermPtr makePrimitive(std::size_t operation, TermPtr church);
+    
+    // Release every term
+    void reset();
+    
+    // Number of distinct nodes built since the last reset
+    std::size_t getNodeCount() const { return nodeCount; }
+    
+    // Size of the largest term built since the last reset
+    std::size_t getPeakSize() const { return peakSize; }
+    
+    // Number of allocations since the last reset
+    std::size_t getAllocationCount() const { return arena.getAllocationCount(); }
+};
+
+// Add delta to every bound index >= cutoff
+TermPtr shift(TermArena& arena, TermPtr term, long delta, std::size_t cutoff = 0);
+
+// Beta reduction: substitute argument for index 0 in the body of an abstraction
+TermPtr instantiate(TermArena& arena, TermPtr body, TermPtr argument);
+
+// Convert a named expression into its nameless form
+TermPtr toDeBruijn(TermArena& arena, const Expression& expr);
+TermPtr toDeBruijn(TermArena& arena, const NodeStore& store, NodeHandle node);
+
+// Convert a nameless term back into a named expression, choosing parameter
+// names from the hints and renaming only where a name would be captured.
+// Native terms become the Church forms they replace, or integer literals.
+// The number of renamed parameters is added to renames if given.
+std::shared_ptr<Expression> fromDeBruijn(TermPtr term, std::size_t* renames = nullptr);
+
+// Convert a nameless term back into named nodes added to a store
+NodeHandle fromDeBruijn(NodeStore& store, TermPtr term, std::size_t* renames = nullptr);
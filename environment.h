@@ -1,51 +1,272 @@
 #pragma once
 
-#include "Expression.h"
+#include "expression.h"
+#include "visitor.h"
+#include "snapshot.h"
+#include "symbol.h"
 #include <string>
-#include <map>
+#include <vector>
+#include <algorithm>
 #include <memory>
 #include <iostream>
 
+// Collects the names a definition refers to
+class ReferenceCollector : public ITraversal {
+private:
+    std::vector<Symbol>& references;
+
+public:
+    explicit ReferenceCollector(std::vector<Symbol>& references) : references(references) {}
+    
+    void visit(const NamedReference& reference) override {
+        if (std::find(references.begin(), references.end(), reference.getSymbol()) == references.end()) {
+            references.push_back(reference.getSymbol());
+        }
+    }
+};
+
 // Environment to store named expressions
 class Environment {
 private:
-    // Map of names to expressions
-    std::map<std::string, std::shared_ptr<Expression>> definitions;
+    struct Entry {
+        std::shared_ptr<Expression> definition;
+        
+        // Snapshot holding the definition instead, and its index there; the
+        // definition is decoded from the snapshot when it is looked up
+        std::shared_ptr<const Snapshot> snapshot;
+        std::size_t encoded = 0;
+        
+        // Memoized normal form, valid when normalized is set; null if the
+        // definition had no normal form within the step limit
+        std::shared_ptr<Expression> normalForm;
+        bool normalized = false;
+        bool normalFormEncoded = false;     // The normal form is in the snapshot
+        
+        // Names this definition refers to, and the definitions referring to it
+        std::vector<Symbol> references;
+        std::vector<Symbol> dependents;
+        
+        // Length of the log of changes when the name was last defined
+        std::size_t revision = 0;
+    };
+    
+    // Definitions indexed by the symbol of their name; symbols are dense,
+    // so lookup is a bounds check and an array access
+    std::vector<Entry> definitions;
+    std::size_t definitionCount = 0;
+    
+    // Names whose definition or memoized normal form changed, once per change
+    std::vector<Symbol> changes;
+    
+    Entry& entry(Symbol name) {
+        if (name >= definitions.size()) {
+            definitions.resize(name + 1);
+        }
+        return definitions[name];
+    }
+    
+    // Forget the normal forms of a definition and everything that depends on it
+    void invalidate(Symbol name) {
+        std::vector<bool> visited(definitions.size(), false);
+        std::vector<Symbol> pending{name};
+        visited[name] = true;
+        while (!pending.empty()) {
+            Entry& current = definitions[pending.back()];
+            if (current.normalized) {
+                changes.push_back(pending.back());
+            }
+            pending.pop_back();
+            current.normalized = false;
+            current.normalFormEncoded = false;
+            current.normalForm.reset();
+            for (Symbol dependent : current.dependents) {
+                if (!visited[dependent]) {
+                    visited[dependent] = true;
+                    pending.push_back(dependent);
+                }
+            }
+        }
+    }
+
+    // Replace the references of a definition and forget the normal forms
+    // that depend on it
+    void relink(Symbol name, const std::vector<Symbol>& references) {
+        Entry& current = entry(name);
+        if (!current.definition && !current.snapshot) {
+            ++definitionCount;
+        }
+        
+        // Unlink the old references before recording the new ones
+        for (Symbol reference : current.references) {
+            auto& dependents = definitions[reference].dependents;
+            dependents.erase(std::remove(dependents.begin(), dependents.end(), name), dependents.end());
+        }
+        current.references = references;
+        changes.push_back(name);
+        current.revision = changes.size();
+        invalidate(name);
+        
+        // May grow the table, so current is not used past this point
+        for (Symbol reference : references) {
+            entry(reference).dependents.push_back(name);
+        }
+    }
 
 public:
-    // Add a definition to the environment
+    // Add a definition to the environment. Cached normal forms that depend
+    // on a previous definition of the name are invalidated.
+    void define(Symbol name, const std::shared_ptr<Expression>& expr) {
+        std::vector<Symbol> references;
+        ReferenceCollector collector(references);
+        traverse(*expr, collector);
+        
+        relink(name, references);
+        Entry& current = definitions[name];
+        current.definition = expr;
+        current.snapshot.reset();
+    }
+    
+    // Add the definitions stored in a snapshot, with the normal forms that
+    // were saved. Defining a name forgets the normal forms of the
+    // definitions using it, so they are only set once every definition is
+    // linked; otherwise a definition loaded before one it uses would lose its own.
+    void define(const std::shared_ptr<const Snapshot>& snapshot) {
+        for (std::size_t i = 0; i < snapshot->getDefinitionCount(); ++i) {
+            Symbol name = snapshot->getName(i);
+            relink(name, snapshot->getReferences(i));
+            Entry& current = definitions[name];
+            current.definition.reset();
+            current.snapshot = snapshot;
+            current.encoded = i;
+        }
+        for (std::size_t i = 0; i < snapshot->getDefinitionCount(); ++i) {
+            Entry& current = definitions[snapshot->getName(i)];
+            current.normalized = current.normalFormEncoded = snapshot->hasNormalForm(i);
+        }
+    }
+    
     void define(const std::string& name, const std::shared_ptr<Expression>& expr) {
-        definitions[name] = expr;
+        define(internSymbol(name), expr);
     }
     
     // Look up a definition
-    std::shared_ptr<Expression> lookup(const std::string& name) const {
-        auto it = definitions.find(name);
-        if (it != definitions.end()) {
-            return it->second;
+    std::shared_ptr<Expression> lookup(Symbol name) const {
+        if (name >= definitions.size()) {
+            return nullptr;
         }
-        return nullptr;
+        const Entry& current = definitions[name];
+        return current.snapshot ? current.snapshot->decodeDefinition(current.encoded) : current.definition;
+    }
+    
+    std::shared_ptr<Expression> lookup(const std::string& name) const {
+        Symbol symbol;
+        return findSymbol(name, symbol) ? lookup(symbol) : nullptr;
     }
     
     // Check if a name is defined
+    bool isDefined(Symbol name) const {
+        return name < definitions.size() && (definitions[name].definition || definitions[name].snapshot);
+    }
+    
     bool isDefined(const std::string& name) const {
-        return definitions.find(name) != definitions.end();
+        Symbol symbol;
+        return findSymbol(name, symbol) && isDefined(symbol);
+    }
+    
+    // Memoized normal form of a definition. Returns false if none has been
+    // computed; otherwise normalForm is null if the definition had none.
+    bool getNormalForm(Symbol name, std::shared_ptr<Expression>& normalForm) const {
+        if (name >= definitions.size() || !definitions[name].normalized) {
+            return false;
+        }
+        const Entry& current = definitions[name];
+        normalForm = current.normalFormEncoded ? current.snapshot->decodeNormalForm(current.encoded) : current.normalForm;
+        return true;
+    }
+    
+    // Memoize the normal form of a definition; null records that it has none
+    void setNormalForm(Symbol name, const std::shared_ptr<Expression>& normalForm) {
+        Entry& current = entry(name);
+        current.normalForm = normalForm;
+        current.normalized = true;
+        current.normalFormEncoded = false;
+        changes.push_back(name);
+    }
+    
+    // Forget every memoized normal form
+    void clearNormalForms() {
+        for (Symbol name = 0; name < definitions.size(); ++name) {
+            Entry& current = definitions[name];
+            if (current.normalized) {
+                changes.push_back(name);
+            }
+            current.normalForm.reset();
+            current.normalized = false;
+            current.normalFormEncoded = false;
+        }
+    }
+    
+    // Definition and memoized normal form of a name as far as they need no
+    // decoding; those held in a snapshot, and missing ones, are null
+    std::shared_ptr<Expression> findDecoded(Symbol name) const {
+        return name < definitions.size() ? definitions[name].definition : nullptr;
+    }
+    
+    std::shared_ptr<Expression> findDecodedNormalForm(Symbol name) const {
+        if (name >= definitions.size() || !definitions[name].normalized || definitions[name].normalFormEncoded) {
+            return nullptr;
+        }
+        return definitions[name].normalForm;
+    }
+    
+    // Number that changes each time a name is defined, zero if it never was.
+    // Definitions held in a snapshot are decoded afresh by every lookup, so
+    // this tells whether a definition changed without decoding it.
+    std::size_t getRevision(Symbol name) const {
+        return name < definitions.size() ? definitions[name].revision : 0;
+    }
+    
+    // Names whose definition or memoized normal form changed, in the order
+    // of the changes; the log only grows, so readers can keep up with it
+    // by remembering how much of it they have seen
+    const std::vector<Symbol>& getChanges() const {
+        return changes;
+    }
+    
+    // Names a definition refers to
+    const std::vector<Symbol>& getReferences(Symbol name) const {
+        static const std::vector<Symbol> none;
+        return name < definitions.size() ? definitions[name].references : none;
+    }
+    
+    // Number of definitions
+    std::size_t size() const {
+        return definitionCount;
+    }
+    
+    // Symbols of all defined names, in alphabetical order
+    std::vector<Symbol> getNames() const {
+        std::vector<Symbol> names;
+        for (Symbol symbol = 0; symbol < definitions.size(); ++symbol) {
+            if (isDefined(symbol)) {
+                names.push_back(symbol);
+            }
+        }
+        std::sort(names.begin(), names.end(), [](Symbol a, Symbol b) {
+            return getSymbolName(a) < getSymbolName(b);
+        });
+        return names;
     }
     
     // Print all definitions
     void printDefinitions() const {
-        if (definitions.empty()) {
+        if (definitionCount == 0) {
             std::cout << "No definitions yet." << std::endl;
             return;
         }
         
-        for (const auto& [name, expr] : definitions) {
-            std::cout << name << " = " << expr->toString() << std::endl;
+        for (Symbol name : getNames()) {
+            std::cout << getSymbolName(name) << " = " << lookup(name)->toString() << std::endl;
         }
     }
-    
-    // Access the definitions map directly (for iteration)
-    const std::map<std::string, std::shared_ptr<Expression>>& getDefinitions() const {
-        return definitions;
-    }
 };
\ No newline at end of file
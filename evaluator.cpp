@@ -1,187 +1,473 @@
-#include "Evaluator.h"
-#include <algorithm>
-#include <queue>
+#include "evaluator.h"
+#include "krivine.h"
+#include "cek.h"
+#include "nbe.h"
+#include "normalorder.h"
+#include "parallel.h"
+#include "bytecode.h"
+#include "vm.h"
+#include <cstdint>
+#include <limits>
+
+// Largest partial result, in tree nodes, converted back after a limit is exceeded
+static constexpr std::size_t maxPartialResultSize = 100000;
+
+// Most closures, thunks and environments an engine may hold when no node
+// limit is set
+static constexpr std::size_t maxMachineNodes = std::size_t(1) << 24;
+
+// Strategy names
+std::string getStrategyName(Strategy strategy) {
+    switch (strategy) {
+        case Strategy::NormalOrder: return "normal";
+        case Strategy::CallByName: return "name";
+        case Strategy::CallByNeed: return "need";
+        case Strategy::Applicative: return "applicative";
+        case Strategy::Nbe: return "nbe";
+        case Strategy::Parallel: return "parallel";
+        case Strategy::Vm: return "vm";
+    }
+    return "unknown";
+}
+
+bool parseStrategy(const std::string& name, Strategy& strategy) {
+    for (auto candidate : {Strategy::NormalOrder, Strategy::CallByName, Strategy::CallByNeed,
+                           Strategy::Applicative, Strategy::Nbe, Strategy::Parallel, Strategy::Vm}) {
+        if (getStrategyName(candidate) == name) {
+            strategy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+Evaluator::Evaluator(Environment& env) : environment(env) {}
+
+Evaluator::~Evaluator() = default;
 
 // Visitor pattern implementation
 void Evaluator::visit(Variable& variable) {
-    // Variables evaluate to themselves
-    result = std::make_shared<Variable>(variable.getName());
+    // Variables are already in normal form
+    reduceOnce(variable);
 }
 
 void Evaluator::visit(Abstraction& abstraction) {
-    // For abstractions, we evaluate the body
-    auto evaluatedBody = evaluateNormalOrder(abstraction.getBody());
-    result = std::make_shared<Abstraction>(abstraction.getParameter(), evaluatedBody);
+    // For abstractions, the leftmost redex is inside the body
+    reduceOnce(abstraction);
 }
 
 void Evaluator::visit(Application& application) {
-    // For applications, we perform beta reduction if possible
-    auto function = application.getFunction();
-    auto argument = application.getArgument();
-    
-    // Check if the function is an abstraction (this is a redex)
-    if (auto abstraction = std::dynamic_pointer_cast<Abstraction>(function)) {
-        // Perform beta reduction: (λx.M) N -> M[x := N]
-        result = substitute(abstraction->getBody(), abstraction->getParameter(), argument);
-    } else {
-        // If not, we just evaluate both parts
-        auto evaluatedFunction = evaluateNormalOrder(function);
-        auto evaluatedArgument = evaluateNormalOrder(argument);
-        result = std::make_shared<Application>(evaluatedFunction, evaluatedArgument);
-    }
+    // For applications, we perform beta reduction if the function is an abstraction,
+    // otherwise we reduce inside the function and then the argument
+    reduceOnce(application);
 }
 
 void Evaluator::visit(NamedReference& reference) {
-    // Look up the definition in the environment
-    auto definition = environment.lookup(reference.getName());
-    if (definition) {
-        // Found a definition, return it
-        result = definition->clone();
+    // Named references are replaced by their definitions
+    reduceOnce(reference);
+}
+
+void Evaluator::visit(IntegerLiteral& literal) {
+    // Integer literals stand for Church numerals, which are in normal form
+    reduceOnce(literal);
+}
+
+// Perform one reduction step on the nameless form of an expression
+void Evaluator::reduceOnce(Expression& expr) {
+    auto term = expandNatives(arena, toDeBruijn(arena, expr), [this](std::size_t nodes) { checkNodes(nodes); });
+    auto reduced = reduceStep(term);
+    if (reduced != term) {
+        result = fromDeBruijn(reduced);
+    }
+}
+
+// Release the terms of the previous evaluation and start counting afresh
+void Evaluator::beginEvaluation() {
+    definitions.clear();
+    natives.clear();
+    engineDefinitions.clear();
+    nativeEvaluation = false;
+    arena.reset();
+    stats = EvaluationStats();
+    partialResult.reset();
+    lazyResult.reset();
+    traceEvaluation = 0;
+    monitor.begin(limits);
+}
+
+// Record the totals of the evaluation that just ended
+void Evaluator::endEvaluation() {
+    stats.nodesAllocated += arena.getNodeCount();
+    stats.peakTermSize = std::max(stats.peakTermSize, arena.getPeakSize());
+    stats.elapsed = monitor.elapsed();
+    if (profiler) {
+        profiler->end(arena.getNodeCount());
+    }
+    if (tracer && traceEvaluation) {
+        trace(TraceKind::End, stats.betaSteps + stats.deltaSteps, 0, 0);
+    }
+}
+
+// Add a record for the current evaluation to the trace; counts that do not
+// fit the record are saturated
+void Evaluator::trace(TraceKind kind, std::size_t steps, Symbol definition, std::size_t size) {
+    auto narrow = [](std::size_t value) {
+        return static_cast<std::uint32_t>(std::min<std::size_t>(value, std::numeric_limits<std::uint32_t>::max()));
+    };
+    tracer->record(TraceRecord{steps, traceEvaluation, definition, narrow(size), narrow(arena.getNodeCount()), kind, {}});
+}
+
+// Check the limits before native integers are expanded into Church
+// numerals of the given number of nodes
+void Evaluator::checkNodes(std::size_t nodes) {
+    monitor.checkNumeral(stats.betaSteps + stats.deltaSteps, arena.getNodeCount() + stats.machineNodes, nodes);
+}
+
+// Charge one reduction step against the limits
+void Evaluator::countStep(StepKind kind, Symbol definition, TermPtr term) {
+    if (kind == StepKind::Beta) {
+        ++stats.betaSteps;
     } else {
-        // If not defined, it's just a variable with the same name
-        result = std::make_shared<Variable>(reference.getName());
+        ++stats.deltaSteps;
+    }
+    std::size_t steps = stats.betaSteps + stats.deltaSteps;
+    if (tracer) {
+        TraceKind traced = kind == StepKind::Beta ? TraceKind::Beta : kind == StepKind::Delta ? TraceKind::Delta : TraceKind::Native;
+        trace(traced, steps, definition, term ? term->size : 0);
+    }
+    if (profiler) {
+        profiler->countStep(kind, definition, term, arena.getNodeCount());
     }
+    monitor.check(steps, arena.getNodeCount() + stats.machineNodes, steps % 1024 == 0);
 }
 
-// Helper method to substitute a variable with an expression
-std::shared_ptr<Expression> Evaluator::substitute(
-    const std::shared_ptr<Expression>& expr,
-    const std::string& var,
-    const std::shared_ptr<Expression>& replacement) {
-    
-    // Case 1: Variable
-    if (auto variable = std::dynamic_pointer_cast<Variable>(expr)) {
-        if (variable->getName() == var) {
-            // If this is the variable we're replacing, return the replacement
-            return replacement->clone();
-        } else {
-            // Otherwise, keep the variable as is
-            return variable->clone();
-        }
+// Charge the objects held by a machine together with the term nodes, so
+// the node limit bounds the memory of every strategy
+void Evaluator::countMachineNodes(std::size_t nodes) {
+    stats.machineNodes = std::max(stats.machineNodes, nodes);
+    if (limits.maxNodes == 0 && nodes > maxMachineNodes) {
+        throw LimitExceededError("Machine of " + std::to_string(nodes) + " closures, thunks and environments is too large");
     }
-    
-    // Case 1.5: Named Reference
-    if (auto reference = std::dynamic_pointer_cast<NamedReference>(expr)) {
-        // Look up the definition and substitute in it
-        auto definition = environment.lookup(reference->getName());
-        if (definition) {
-            return substitute(definition, var, replacement);
-        } else {
-            // If not defined, treat it as a variable
-            if (reference->getName() == var) {
-                return replacement->clone();
-            } else {
-                return reference->clone();
+    monitor.check(stats.betaSteps + stats.deltaSteps, arena.getNodeCount() + nodes, true);
+}
+
+// Run the engine of a strategy on the nameless form of an input and convert
+// the normal form with output. When a limit stops the engine, the statistics
+// and any partial result are kept.
+template <typename Input, typename Output>
+auto Evaluator::run(Strategy engine, Input input, Output output) {
+    beginEvaluation();
+    bool native = nativeArithmetic && engine == Strategy::NormalOrder;
+    nativeEvaluation = native;
+    try {
+        TermPtr term = input();
+        if (tracer) {
+            traceEvaluation = tracer->nextEvaluation();
+            trace(TraceKind::Begin, 0, 0, term->size);
+        }
+        NodeCheck check = [this](std::size_t nodes) { checkNodes(nodes); };
+        term = native ? natives.recognize(term) : expandNatives(arena, term, check);
+        if (profiler) {
+            profiler->begin(term, arena.getNodeCount());
+        }
+        auto normalForm = output(expandNatives(arena, normalizeWith(engine, term), check));
+        endEvaluation();
+        return normalForm;
+    } catch (const LimitExceededError& error) {
+        stats.stopReason = error.what();
+        // Shared subterms are copied apart when printed, so very large partial results are dropped
+        TermPtr partial = error.getPartialResult();
+        if (partial) {
+            try {
+                partial = expandNatives(arena, partial, [](std::size_t nodes) {
+                    if (nodes > maxPartialResultSize) {
+                        throw LimitExceededError("Partial result too large");
+                    }
+                });
+            } catch (const LimitExceededError&) {
+                partial = nullptr;
             }
         }
+        if (partial && partial->size <= maxPartialResultSize) {
+            partialResult = fromDeBruijn(partial, &stats.renames);
+        }
+        endEvaluation();
+        throw;
+    } catch (...) {
+        endEvaluation();
+        throw;
+    }
+}
+
+// Look up the nameless form of a definition, with native terms recognized
+// in native evaluations and expanded in all others
+TermPtr Evaluator::lookupDefinition(Symbol name) {
+    if (name < engineDefinitions.size() && engineDefinitions[name]) {
+        return engineDefinitions[name];
+    }
+    if (profiler) {
+        profiler->beginLookup(arena.getNodeCount());
     }
     
-    // Case 2: Abstraction
-    if (auto abstraction = std::dynamic_pointer_cast<Abstraction>(expr)) {
-        if (abstraction->getParameter() == var) {
-            // If the parameter shadows our variable, don't substitute in the body
-            return abstraction->clone();
-        } else {
-            // Check if the parameter occurs free in the replacement
-            auto freeVarsInReplacement = getFreeVariables(replacement);
-            if (freeVarsInReplacement.find(abstraction->getParameter()) != freeVarsInReplacement.end()) {
-                // Parameter capture would occur - rename the parameter
-                auto allVars = getFreeVariables(expr);
-                allVars.insert(freeVarsInReplacement.begin(), freeVarsInReplacement.end());
-                auto freshVar = generateFreshVariable(allVars, abstraction->getParameter());
-                
-                // Create a new abstraction with the renamed parameter
-                auto renamedBody = substitute(abstraction->getBody(), 
-                                             abstraction->getParameter(), 
-                                             std::make_shared<Variable>(freshVar));
-                
-                // Now substitute in the renamed body
-                auto newBody = substitute(renamedBody, var, replacement);
-                return std::make_shared<Abstraction>(freshVar, newBody);
-            } else {
-                // No parameter capture - substitute in the body
-                auto newBody = substitute(abstraction->getBody(), var, replacement);
-                return std::make_shared<Abstraction>(abstraction->getParameter(), newBody);
-            }
+    TermPtr definition = definitions.lookup(name);
+    if (!definition) {
+        return nullptr;
+    }
+    if (name >= engineDefinitions.size()) {
+        engineDefinitions.resize(name + 1, nullptr);
+    }
+    engineDefinitions[name] = nativeEvaluation ? natives.recognize(definition)
+                                               : expandNatives(arena, definition, [this](std::size_t nodes) { checkNodes(nodes); });
+    return engineDefinitions[name];
+}
+
+// Perform the leftmost outermost reduction step. Terms are hash-consed, so
+// a term without a redex comes back as the very same node.
+TermPtr Evaluator::reduceStep(TermPtr term) {
+    // Search the term in preorder, which visits redexes from the outside in
+    // and from left to right, remembering how each node was reached
+    struct Visited {
+        TermPtr term;
+        std::size_t parent;
+        bool isArgument;
+    };
+    constexpr std::size_t root = static_cast<std::size_t>(-1);
+    
+    std::vector<Visited> visited;
+    std::vector<Visited> pending{{term, root, false}};
+    TermPtr reduced = nullptr;
+    
+    while (!pending.empty() && !reduced) {
+        visited.push_back(pending.back());
+        pending.pop_back();
+        TermPtr current = visited.back().term;
+        std::size_t self = visited.size() - 1;
+        
+        switch (current->kind) {
+            case TermKind::Reference:
+                reduced = lookupDefinition(current->name);
+                break;
+            case TermKind::Abstraction:
+                pending.push_back({current->left, self, false});
+                break;
+            case TermKind::Application:
+                if (current->left->kind == TermKind::Abstraction) {
+                    // (λ.M) N -> M[0 := N]
+                    reduced = instantiate(arena, current->left->left, current->right);
+                } else {
+                    pending.push_back({current->right, self, true});
+                    pending.push_back({current->left, self, false});
+                }
+                break;
+            default:
+                break;
         }
     }
     
-    // Case 3: Application
-    if (auto application = std::dynamic_pointer_cast<Application>(expr)) {
-        auto newFunction = substitute(application->getFunction(), var, replacement);
-        auto newArgument = substitute(application->getArgument(), var, replacement);
-        return std::make_shared<Application>(newFunction, newArgument);
+    if (!reduced) {
+        return term;
     }
     
-    // Default case (shouldn't happen with well-formed expressions)
-    return expr->clone();
+    // Rebuild the path from the redex back up to the root
+    for (std::size_t i = visited.size() - 1; visited[i].parent != root; i = visited[i].parent) {
+        TermPtr parent = visited[visited[i].parent].term;
+        if (parent->kind == TermKind::Abstraction) {
+            reduced = arena.makeAbstraction(parent->name, reduced);
+        } else if (visited[i].isArgument) {
+            reduced = arena.makeApplication(parent->left, reduced);
+        } else {
+            reduced = arena.makeApplication(reduced, parent->right);
+        }
+    }
+    return reduced;
 }
 
-// Helper method to get all free variables in an expression
-std::unordered_set<std::string> Evaluator::getFreeVariables(const std::shared_ptr<Expression>& expr) {
-    std::unordered_set<std::string> freeVars;
-    
-    if (auto variable = std::dynamic_pointer_cast<Variable>(expr)) {
-        freeVars.insert(variable->getName());
-    } else if (auto reference = std::dynamic_pointer_cast<NamedReference>(expr)) {
-        // For a named reference, get free variables from its definition
-        auto definition = environment.lookup(reference->getName());
-        if (definition) {
-            freeVars = getFreeVariables(definition);
-        } else {
-            // If not defined, treat it as a variable
-            freeVars.insert(reference->getName());
+// Evaluate with the selected strategy
+std::shared_ptr<Expression> Evaluator::evaluate(const std::shared_ptr<Expression>& expr) {
+    return evaluateWith(strategy, expr);
+}
+
+// Evaluate a node of a store, reading it and writing its normal form without Expression nodes
+NodeHandle Evaluator::evaluate(NodeStore& store, NodeHandle node) {
+    return run(strategy, [&]() {
+        return toDeBruijn(arena, store, node);
+    }, [&](TermPtr normalForm) {
+        return fromDeBruijn(store, normalForm, &stats.renames);
+    });
+}
+
+std::shared_ptr<Expression> Evaluator::evaluateWith(Strategy engine, const std::shared_ptr<Expression>& expr) {
+    return run(engine, [&]() {
+        return toDeBruijn(arena, *expr);
+    }, [this](TermPtr normalForm) {
+        return fromDeBruijn(normalForm, &stats.renames);
+    });
+}
+
+// Normalize a term with the engine of a strategy
+TermPtr Evaluator::normalizeWith(Strategy engine, TermPtr term) {
+    switch (engine) {
+        case Strategy::CallByName:
+        case Strategy::CallByNeed: {
+            KrivineMachine machine(*this, engine == Strategy::CallByNeed);
+            return machine.normalize(term);
+        }
+        case Strategy::Applicative: {
+            CekMachine machine(*this);
+            return machine.normalize(term);
+        }
+        case Strategy::Nbe: {
+            NbeEvaluator nbe(*this);
+            return nbe.normalize(term);
+        }
+        case Strategy::Parallel:
+            return normalizeParallel(term);
+        case Strategy::Vm: {
+            // Bytecode of the definitions is kept across evaluations
+            if (!program) {
+                program = std::make_unique<Program>();
+            }
+            std::uint32_t entry = program->compileExpression(environment, arena, term, [this](std::size_t nodes) { checkNodes(nodes); });
+            VirtualMachine machine(*this, *program);
+            return machine.normalize(entry);
+        }
+        default: {
+            NormalOrderReducer reducer(*this);
+            return reducer.normalize(term);
         }
-    } else if (auto abstraction = std::dynamic_pointer_cast<Abstraction>(expr)) {
-        freeVars = getFreeVariables(abstraction->getBody());
-        freeVars.erase(abstraction->getParameter());
-    } else if (auto application = std::dynamic_pointer_cast<Application>(expr)) {
-        auto functionVars = getFreeVariables(application->getFunction());
-        auto argumentVars = getFreeVariables(application->getArgument());
-        freeVars.insert(functionVars.begin(), functionVars.end());
-        freeVars.insert(argumentVars.begin(), argumentVars.end());
     }
-    
-    return freeVars;
 }
 
-// Helper method to generate a fresh variable name
-std::string Evaluator::generateFreshVariable(const std::unordered_set<std::string>& usedVars, 
-                                           const std::string& hint) {
-    std::string base = hint;
-    int suffix = 0;
-    std::string freshVar = base;
+// Normalize on the thread pool of the parallel reducer
+TermPtr Evaluator::normalizeParallel(TermPtr term) {
+    if (!parallelReducer) {
+        parallelReducer = std::make_unique<ParallelReducer>(environment, threadCount, parallelThreshold);
+    }
     
-    while (usedVars.find(freshVar) != usedVars.end()) {
-        freshVar = base + std::to_string(++suffix);
+    // Memoize the definitions used here while still on one thread
+    std::vector<TermPtr> pending{term};
+    while (!pending.empty()) {
+        TermPtr current = pending.back();
+        pending.pop_back();
+        if (current->kind == TermKind::Reference) {
+            lookupDefinition(current->name);
+        } else if (current->kind == TermKind::Abstraction || current->kind == TermKind::Application) {
+            pending.push_back(current->left);
+            if (current->right) {
+                pending.push_back(current->right);
+            }
+        }
     }
     
-    return freshVar;
+    try {
+        term = parallelReducer->normalize(term, limits);
+    } catch (...) {
+        parallelReducer->collectStats(stats);
+        throw;
+    }
+    parallelReducer->collectStats(stats);
+    return term;
+}
+
+// Lazy results own their evaluation; the result is kept for its statistics.
+// Definitions are memoized in the environment as by the other strategies.
+LazyResult Evaluator::evaluateLazily(const std::shared_ptr<Expression>& expr, HeadForm form) {
+    stats = EvaluationStats();
+    partialResult.reset();
+    lazyResult.reset();
+    try {
+        lazyResult = LazyResult::evaluate(environment, expr, form, limits, nativeArithmetic, definitions.getNormalizeLimit());
+        return *lazyResult;
+    } catch (const LimitExceededError& error) {
+        stats.stopReason = error.what();
+        throw;
+    }
 }
 
 // Evaluate using normal order reduction
 std::shared_ptr<Expression> Evaluator::evaluateNormalOrder(const std::shared_ptr<Expression>& expr) {
-    if (isNormalForm(expr)) {
-        return expr->clone();
+    return evaluateWith(Strategy::NormalOrder, expr);
+}
+
+// Evaluate using normal order reduction on the thread pool
+std::shared_ptr<Expression> Evaluator::evaluateParallel(const std::shared_ptr<Expression>& expr) {
+    return evaluateWith(Strategy::Parallel, expr);
+}
+
+// Evaluate by compiling to bytecode for the virtual machine
+std::shared_ptr<Expression> Evaluator::evaluateVm(const std::shared_ptr<Expression>& expr) {
+    return evaluateWith(Strategy::Vm, expr);
+}
+
+// Select the step limit for memoizing definitions; memoized normal forms
+// depend on it, so they are recomputed under the new limit
+void Evaluator::setDefinitionStepLimit(std::size_t limit) {
+    definitions.setNormalizeLimit(limit);
+    environment.clearNormalForms();
+}
+
+// Memoize the normal form of every definition that has none yet
+void Evaluator::normalizeDefinitions() {
+    beginEvaluation();
+    try {
+        for (Symbol name : environment.getNames()) {
+            definitions.lookup(name);
+        }
+    } catch (...) {
+        endEvaluation();
+        throw;
     }
-    
-    auto reduced = betaReduce(expr);
-    return evaluateNormalOrder(reduced);
+    endEvaluation();
+}
+
+// Select the size threshold for forking
+void Evaluator::setParallelThreshold(std::size_t size) {
+    parallelThreshold = size;
+    if (parallelReducer) {
+        parallelReducer->setThreshold(size);
+    }
+}
+
+// Select the number of threads; the pool is restarted on next use
+void Evaluator::setThreadCount(std::size_t count) {
+    threadCount = count;
+    parallelReducer.reset();
+}
+
+// Evaluate with the Krivine machine
+std::shared_ptr<Expression> Evaluator::evaluateCallByName(const std::shared_ptr<Expression>& expr) {
+    return evaluateWith(Strategy::CallByName, expr);
+}
+
+// Evaluate with the Krivine machine and shared thunks
+std::shared_ptr<Expression> Evaluator::evaluateCallByNeed(const std::shared_ptr<Expression>& expr) {
+    return evaluateWith(Strategy::CallByNeed, expr);
+}
+
+// Evaluate by normalization by evaluation
+std::shared_ptr<Expression> Evaluator::evaluateNbE(const std::shared_ptr<Expression>& expr) {
+    return evaluateWith(Strategy::Nbe, expr);
 }
 
 // Evaluate using applicative order reduction
 std::shared_ptr<Expression> Evaluator::evaluateApplicativeOrder(const std::shared_ptr<Expression>& expr) {
-    // To be implemented later - for now, use normal order
-    return evaluateNormalOrder(expr);
+    return evaluateWith(Strategy::Applicative, expr);
 }
 
 // Perform a single beta reduction step
 std::shared_ptr<Expression> Evaluator::betaReduce(const std::shared_ptr<Expression>& expr) {
     // Reset result
     result.reset();
+    beginEvaluation();
     
     // Use the visitor pattern to perform reduction
-    expr->accept(*this);
+    try {
+        expr->accept(*this);
+    } catch (...) {
+        endEvaluation();
+        throw;
+    }
+    endEvaluation();
     
     // If no reduction was performed, return the original expression
     if (!result) {
@@ -193,7 +479,16 @@ std::shared_ptr<Expression> Evaluator::betaReduce(const std::shared_ptr<Expressi
 
 // Check if an expression is in normal form
 bool Evaluator::isNormalForm(const std::shared_ptr<Expression>& expr) {
-    // Check if expression can be reduced further
-    auto reduced = betaReduce(expr);
-    return reduced->toString() == expr->toString();
-}
\ No newline at end of file
+    beginEvaluation();
+    try {
+        auto term = expandNatives(arena, toDeBruijn(arena, *expr), [this](std::size_t nodes) { checkNodes(nodes); });
+        
+        // Equal terms are the same node, so the fixpoint check is a pointer comparison
+        bool normal = reduceStep(term) == term;
+        endEvaluation();
+        return normal;
+    } catch (...) {
+        endEvaluation();
+        throw;
+    }
+}
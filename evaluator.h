@@ -1,44 +1,225 @@
 #pragma once
 
-#include "Expression.h"
-#include "Visitor.h"
-#include "Environment.h"
-#include <unordered_set>
+#include "expression.h"
+#include "visitor.h"
+#include "environment.h"
+#include "debruijn.h"
+#include "reduction.h"
+#include "native.h"
+#include "lazy.h"
+#include "trace.h"
+#include "profiler.h"
+#include <memory>
+#include <optional>
 
-// Evaluator for lambda expressions using the visitor pattern
-class Evaluator : public IVisitor {
+// Evaluation strategies the Evaluator can use
+enum class Strategy {
+    NormalOrder,    // Leftmost outermost redex first, by substitution
+    CallByName,     // Krivine machine with closures
+    CallByNeed,     // Krivine machine with shared thunks
+    Applicative,    // CEK machine, arguments reduced to values first
+    Nbe,            // Normalization by evaluation
+    Parallel,       // Normal order with independent subterms reduced in parallel
+    Vm              // Bytecode compiled once per definition, run by a call-by-need machine
+};
+
+// Name used for a strategy in the REPL
+std::string getStrategyName(Strategy strategy);
+
+// Look up a strategy by its name; returns false if the name is unknown
+bool parseStrategy(const std::string& name, Strategy& strategy);
+
+class ParallelReducer;
+class Program;
+
+// Evaluator for lambda expressions using the visitor pattern.
+// Reduction works on the nameless form from debruijn.h, so substitution
+// only shifts indices and never needs alpha conversion.
+class Evaluator : public IVisitor, private IReductionContext {
 private:
     std::shared_ptr<Expression> result;
     Environment& environment;
     
+    // Holds the intermediate terms of the current evaluation; only the
+    // final result is copied out into Expression nodes
+    TermArena arena;
+    
+    // Nameless forms of the definitions used during the current evaluation
+    DefinitionCache definitions{environment, arena, 10000, &monitor};
+    
+    // Native arithmetic: whether it is enabled, whether the current
+    // evaluation uses it, and the definitions as the engines see them,
+    // with native terms recognized or expanded
+    bool nativeArithmetic = false;
+    bool nativeEvaluation = false;
+    NativeRecognizer natives{arena};
+    std::vector<TermPtr> engineDefinitions;
+    
+    // Strategy used by evaluate()
+    Strategy strategy = Strategy::NormalOrder;
+    
+    // Limits and counters of the current evaluation
+    EvaluationLimits limits;
+    EvaluationStats stats;
+    LimitMonitor monitor;
+    
+    // Term reduced so far when a limit stopped the last evaluation
+    std::shared_ptr<Expression> partialResult;
+    
+    // Result of the last evaluation if it was lazy. Its counters stand for
+    // the last evaluation's, so they include its expansions.
+    std::optional<LazyResult> lazyResult;
+    
+    // Reducer for the parallel strategy, started on first use
+    std::unique_ptr<ParallelReducer> parallelReducer;
+    std::size_t parallelThreshold = 64;
+    std::size_t threadCount = 0;
+    
+    // Bytecode of the definitions for the vm strategy, kept across evaluations
+    std::unique_ptr<Program> program;
+    
+    // Receives a record of every step when set, and the number of the
+    // current evaluation in its trace
+    Tracer* tracer = nullptr;
+    std::uint32_t traceEvaluation = 0;
+    
+    // Charged with the costs of every evaluation when set
+    Profiler* profiler = nullptr;
+    
+    // Reduction context used by the evaluation engines
+    TermArena& getArena() override { return arena; }
+    TermPtr lookupDefinition(Symbol name) override;
+    void countStep(StepKind kind, Symbol definition, TermPtr term) override;
+    void countMachineNodes(std::size_t nodes) override;
+    
     // Helper methods for evaluation
-    std::shared_ptr<Expression> substitute(
-        const std::shared_ptr<Expression>& expr,
-        const std::string& var,
-        const std::shared_ptr<Expression>& replacement);
-    
-    std::unordered_set<std::string> getFreeVariables(const std::shared_ptr<Expression>& expr);
-    std::string generateFreshVariable(const std::unordered_set<std::string>& usedVars, 
-                                      const std::string& hint = "x");
+    void beginEvaluation();
+    void endEvaluation();
+    void trace(TraceKind kind, std::size_t steps, Symbol definition, std::size_t size);
+    void checkNodes(std::size_t nodes);
+    template <typename Input, typename Output>
+    auto run(Strategy engine, Input input, Output output);
+    TermPtr normalizeWith(Strategy engine, TermPtr term);
+    TermPtr normalizeParallel(TermPtr term);
+    std::shared_ptr<Expression> evaluateWith(Strategy engine, const std::shared_ptr<Expression>& expr);
+    TermPtr reduceStep(TermPtr term);
+    void reduceOnce(Expression& expr);
 
 public:
-    explicit Evaluator(Environment& env) : environment(env) {}
+    explicit Evaluator(Environment& env);
+    ~Evaluator();
     
     // Visitor pattern implementation
     void visit(Variable& variable) override;
     void visit(Abstraction& abstraction) override;
     void visit(Application& application) override;
     void visit(NamedReference& reference) override;
+    void visit(IntegerLiteral& literal) override;
+    
+    // Evaluate to normal form with the selected strategy
+    std::shared_ptr<Expression> evaluate(const std::shared_ptr<Expression>& expr);
+    
+    // Evaluate a node of a store with the selected strategy; the normal form
+    // is added to the same store
+    NodeHandle evaluate(NodeStore& store, NodeHandle node);
+    
+    // Reduce only to weak head or head normal form by normal order, under
+    // the current limits and native arithmetic setting. Subterms below the
+    // head are reduced when the result is asked for them, against the
+    // environment, which must outlive the result.
+    LazyResult evaluateLazily(const std::shared_ptr<Expression>& expr, HeadForm form);
     
     // Evaluate using normal order reduction (outermost, leftmost redex first)
     std::shared_ptr<Expression> evaluateNormalOrder(const std::shared_ptr<Expression>& expr);
     
-    // Evaluate using applicative order reduction (innermost redexes first)
+    // Evaluate to the same normal form with a Krivine machine, which passes
+    // arguments as closures instead of substituting them
+    std::shared_ptr<Expression> evaluateCallByName(const std::shared_ptr<Expression>& expr);
+    
+    // Evaluate to the same normal form with shared arguments: each argument
+    // is reduced at most once and the result reused at every occurrence
+    std::shared_ptr<Expression> evaluateCallByNeed(const std::shared_ptr<Expression>& expr);
+    
+    // Evaluate to the same normal form by normalization by evaluation: the term
+    // is evaluated into closures and neutral terms and quoted back in one pass
+    std::shared_ptr<Expression> evaluateNbE(const std::shared_ptr<Expression>& expr);
+    
+    // Evaluate using applicative order reduction (innermost redexes first) on a
+    // CEK machine; only for terms that terminate under strict evaluation
     std::shared_ptr<Expression> evaluateApplicativeOrder(const std::shared_ptr<Expression>& expr);
     
+    // Evaluate to the same normal form as normal order, normalizing the
+    // arguments of stuck applications as parallel tasks when they are large
+    std::shared_ptr<Expression> evaluateParallel(const std::shared_ptr<Expression>& expr);
+    
+    // Evaluate to the same normal form by compiling the expression to
+    // bytecode and running it on a call-by-need virtual machine. Definitions
+    // are compiled the first time they are used and reused until redefined.
+    std::shared_ptr<Expression> evaluateVm(const std::shared_ptr<Expression>& expr);
+    
     // Perform a single beta reduction step
     std::shared_ptr<Expression> betaReduce(const std::shared_ptr<Expression>& expr);
     
     // Check if an expression is in normal form (cannot be reduced further)
     bool isNormalForm(const std::shared_ptr<Expression>& expr);
-};
\ No newline at end of file
+    
+    // Select the strategy used by evaluate()
+    void setStrategy(Strategy newStrategy) { strategy = newStrategy; }
+    Strategy getStrategy() const { return strategy; }
+    
+    // Limit the number of reduction steps; evaluation throws LimitExceededError when exceeded
+    void setStepLimit(std::size_t limit) { limits.maxSteps = limit; }
+    std::size_t getStepLimit() const { return limits.maxSteps; }
+    
+    // Limit steps, time and term nodes per evaluation; zero means unlimited
+    void setLimits(const EvaluationLimits& newLimits) { limits = newLimits; }
+    const EvaluationLimits& getLimits() const { return limits; }
+    
+    // Counters of the last evaluation, also when a limit stopped it. Those
+    // of a lazy evaluation add up its expansions and normalizations so far.
+    const EvaluationStats& getStats() const { return lazyResult ? lazyResult->getStats() : stats; }
+    
+    // Number of reduction steps performed by the last evaluation
+    std::size_t getStepCount() const { return getStats().betaSteps + getStats().deltaSteps; }
+    
+    // Term reduced so far when a limit stopped the last evaluation, or null.
+    // Only the normal order and parallel strategies can provide one.
+    std::shared_ptr<Expression> getPartialResult() const { return partialResult; }
+    
+    // Limit the steps spent normalizing each definition the first time it is
+    // used; zero disables memoization of normal forms in the environment
+    void setDefinitionStepLimit(std::size_t limit);
+    std::size_t getDefinitionStepLimit() const { return definitions.getNormalizeLimit(); }
+    
+    // Memoize the normal form of every definition that has none yet, within
+    // the definition step limit, for example before saving a snapshot
+    void normalizeDefinitions();
+    
+    // Evaluate integer literals and Church arithmetic with native integers
+    // under the normal order strategy. Results are read back as Church
+    // numerals, as the other strategies compute them. Primitives normalize
+    // their arguments within a step budget and are unfolded into their
+    // Church encodings when it runs out, so results match the pure mode.
+    void setNativeArithmetic(bool enabled) { nativeArithmetic = enabled; }
+    bool getNativeArithmetic() const { return nativeArithmetic; }
+    
+    // Smallest argument, in term nodes, worth normalizing as a separate task
+    void setParallelThreshold(std::size_t size);
+    std::size_t getParallelThreshold() const { return parallelThreshold; }
+    
+    // Record every reduction step to a trace, or stop tracing with null. The
+    // tracer is not owned and may be shared by several evaluators. Steps of
+    // the parallel strategy are not recorded, only its evaluations.
+    void setTracer(Tracer* newTracer) { tracer = newTracer; }
+    Tracer* getTracer() const { return tracer; }
+    
+    // Charge the costs of every evaluation to the definitions they came
+    // from, or stop profiling with null. The profiler is not owned. Steps
+    // of the parallel strategy are not charged.
+    void setProfiler(Profiler* newProfiler) { profiler = newProfiler; }
+    Profiler* getProfiler() const { return profiler; }
+    
+    // Number of worker threads for the parallel strategy; zero means one per hardware thread
+    void setThreadCount(std::size_t count);
+    std::size_t getThreadCount() const { return threadCount; }
+};
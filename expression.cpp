@@ -1,5 +1,6 @@
-#include "Expression.h"
-#include "Visitor.h"
+#include "expression.h"
+#include "visitor.h"
+#include "printer.h"
 
 // Implementation of the accept methods for each expression type
 
@@ -17,4 +18,148 @@ void Application::accept(IVisitor& visitor) {
 
 void NamedReference::accept(IVisitor& visitor) {
     visitor.visit(*this);
-}
\ No newline at end of file
+}
+
+void IntegerLiteral::accept(IVisitor& visitor) {
+    visitor.visit(*this);
+}
+
+// Printed by a visitor with an explicit stack, so deep expressions print in linear time
+std::string Expression::toString() const {
+    PrettyPrinter printer;
+    return printer.toString(*this);
+}
+
+// Dispatches each node of a traversal to its hooks and schedules its children
+class TraversalDispatcher : public IVisitor {
+public:
+    enum class Step {
+        Enter,
+        SeparateApplication,
+        LeaveAbstraction,
+        LeaveApplication
+    };
+    
+    struct Frame {
+        const Expression* expr;
+        Step step;
+    };
+    
+    ITraversal& traversal;
+    std::vector<Frame> frames;
+    
+    explicit TraversalDispatcher(ITraversal& traversal) : traversal(traversal) {}
+    
+    void visit(Variable& variable) override {
+        traversal.visit(variable);
+    }
+    
+    void visit(Abstraction& abstraction) override {
+        if (traversal.enter(abstraction)) {
+            frames.push_back({&abstraction, Step::LeaveAbstraction});
+            frames.push_back({abstraction.getBody().get(), Step::Enter});
+        }
+    }
+    
+    void visit(Application& application) override {
+        if (traversal.enter(application)) {
+            frames.push_back({&application, Step::LeaveApplication});
+            frames.push_back({application.getArgument().get(), Step::Enter});
+            frames.push_back({&application, Step::SeparateApplication});
+            frames.push_back({application.getFunction().get(), Step::Enter});
+        }
+    }
+    
+    void visit(NamedReference& reference) override {
+        traversal.visit(reference);
+    }
+    
+    void visit(IntegerLiteral& literal) override {
+        traversal.visit(literal);
+    }
+};
+
+void traverse(const Expression& root, ITraversal& traversal) {
+    TraversalDispatcher dispatcher(traversal);
+    dispatcher.frames.push_back({&root, TraversalDispatcher::Step::Enter});
+    
+    while (!dispatcher.frames.empty()) {
+        auto frame = dispatcher.frames.back();
+        dispatcher.frames.pop_back();
+        switch (frame.step) {
+            case TraversalDispatcher::Step::Enter:
+                // Visitors take mutable references, but traversals never modify the expression
+                const_cast<Expression*>(frame.expr)->accept(dispatcher);
+                break;
+            case TraversalDispatcher::Step::SeparateApplication:
+                traversal.separate(static_cast<const Application&>(*frame.expr));
+                break;
+            case TraversalDispatcher::Step::LeaveAbstraction:
+                traversal.leave(static_cast<const Abstraction&>(*frame.expr));
+                break;
+            case TraversalDispatcher::Step::LeaveApplication:
+                traversal.leave(static_cast<const Application&>(*frame.expr));
+                break;
+        }
+    }
+}
+
+// Copies an expression bottom up, keeping the copies of finished subexpressions on a stack
+class Cloner : public ITraversal {
+private:
+    std::vector<std::shared_ptr<Expression>> results;
+    
+    std::shared_ptr<Expression> pop() {
+        auto expr = std::move(results.back());
+        results.pop_back();
+        return expr;
+    }
+
+public:
+    void visit(const Variable& variable) override {
+        results.push_back(std::make_shared<Variable>(variable.getSymbol()));
+    }
+    
+    void visit(const NamedReference& reference) override {
+        results.push_back(std::make_shared<NamedReference>(reference.getSymbol()));
+    }
+    
+    void visit(const IntegerLiteral& literal) override {
+        results.push_back(std::make_shared<IntegerLiteral>(literal.getValue()));
+    }
+    
+    void leave(const Abstraction& abstraction) override {
+        auto body = pop();
+        results.push_back(std::make_shared<Abstraction>(abstraction.getParameterSymbol(), std::move(body)));
+    }
+    
+    void leave(const Application&) override {
+        auto argument = pop();
+        auto function = pop();
+        results.push_back(std::make_shared<Application>(std::move(function), std::move(argument)));
+    }
+    
+    std::shared_ptr<Expression> getResult() {
+        return pop();
+    }
+};
+
+std::shared_ptr<Expression> Expression::clone() const {
+    Cloner cloner;
+    traverse(*this, cloner);
+    return cloner.getResult();
+}
+
+void Expression::releaseChildren() {
+    std::vector<std::shared_ptr<Expression>> pending;
+    takeChildren(pending);
+    while (!pending.empty()) {
+        std::shared_ptr<Expression> child = std::move(pending.back());
+        pending.pop_back();
+        
+        // A child shared with other owners outlives this node and keeps its subexpressions
+        if (child.use_count() == 1) {
+            child->takeChildren(pending);
+        }
+    }
+}
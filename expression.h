@@ -1,13 +1,16 @@
 #pragma once
 
+#include "symbol.h"
 #include <string>
 #include <memory>
+#include <vector>
 
 // Forward declarations
 class Variable;
 class Abstraction;
 class Application;
 class NamedReference;
+class IntegerLiteral;
 class IVisitor;
 
 // Base Expression class
@@ -19,31 +22,37 @@ public:
     virtual void accept(IVisitor& visitor) = 0;
     
     // Helper method to create a deep copy of the expression
-    virtual std::shared_ptr<Expression> clone() const = 0;
+    std::shared_ptr<Expression> clone() const;
     
-    // Helper method to convert expression to string for display
-    virtual std::string toString() const = 0;
+    // Helper method to convert expression to string for display; see PrettyPrinter
+    std::string toString() const;
+
+protected:
+    // Move the subexpressions this node owns into children
+    virtual void takeChildren(std::vector<std::shared_ptr<Expression>>&) {}
+    
+    // Called by the destructors of nodes with children. Children owned only
+    // by the dying node are emptied before they are destroyed, so a long
+    // chain of nodes is freed in a loop instead of by nested destructors.
+    void releaseChildren();
 };
 
 // Variable expression (represents a variable in lambda calculus)
 class Variable : public Expression {
 private:
-    std::string name;
+    Symbol name;
 
 public:
-    explicit Variable(std::string name) : name(std::move(name)) {}
+    explicit Variable(Symbol name) : name(name) {}
+    explicit Variable(const std::string& name) : name(internSymbol(name)) {}
     
     void accept(IVisitor& visitor) override;
     
-    std::shared_ptr<Expression> clone() const override {
-        return std::make_shared<Variable>(name);
-    }
-    
-    std::string toString() const override {
-        return name;
+    const std::string& getName() const {
+        return getSymbolName(name);
     }
     
-    const std::string& getName() const {
+    Symbol getSymbol() const {
         return name;
     }
 };
@@ -51,30 +60,36 @@ public:
 // Abstraction expression (represents a lambda abstraction: λx.M)
 class Abstraction : public Expression {
 private:
-    std::string parameter;
+    Symbol parameter;
     std::shared_ptr<Expression> body;
 
 public:
-    Abstraction(std::string parameter, std::shared_ptr<Expression> body)
-        : parameter(std::move(parameter)), body(std::move(body)) {}
+    Abstraction(Symbol parameter, std::shared_ptr<Expression> body)
+        : parameter(parameter), body(std::move(body)) {}
+    Abstraction(const std::string& parameter, std::shared_ptr<Expression> body)
+        : parameter(internSymbol(parameter)), body(std::move(body)) {}
+    ~Abstraction() override { releaseChildren(); }
     
     void accept(IVisitor& visitor) override;
     
-    std::shared_ptr<Expression> clone() const override {
-        return std::make_shared<Abstraction>(parameter, body->clone());
-    }
-    
-    std::string toString() const override {
-        return "λ" + parameter + "." + body->toString();
+    const std::string& getParameter() const {
+        return getSymbolName(parameter);
     }
     
-    const std::string& getParameter() const {
+    Symbol getParameterSymbol() const {
         return parameter;
     }
     
     const std::shared_ptr<Expression>& getBody() const {
         return body;
     }
+
+protected:
+    void takeChildren(std::vector<std::shared_ptr<Expression>>& children) override {
+        if (body) {
+            children.push_back(std::move(body));
+        }
+    }
 };
 
 // Application expression (represents function application: M N)
@@ -86,17 +101,10 @@ private:
 public:
     Application(std::shared_ptr<Expression> function, std::shared_ptr<Expression> argument)
         : function(std::move(function)), argument(std::move(argument)) {}
+    ~Application() override { releaseChildren(); }
     
     void accept(IVisitor& visitor) override;
     
-    std::shared_ptr<Expression> clone() const override {
-        return std::make_shared<Application>(function->clone(), argument->clone());
-    }
-    
-    std::string toString() const override {
-        return "(" + function->toString() + " " + argument->toString() + ")";
-    }
-    
     const std::shared_ptr<Expression>& getFunction() const {
         return function;
     }
@@ -104,27 +112,49 @@ public:
     const std::shared_ptr<Expression>& getArgument() const {
         return argument;
     }
+
+protected:
+    void takeChildren(std::vector<std::shared_ptr<Expression>>& children) override {
+        if (function) {
+            children.push_back(std::move(function));
+        }
+        if (argument) {
+            children.push_back(std::move(argument));
+        }
+    }
 };
 
 // Named reference expression (refers to a defined expression)
 class NamedReference : public Expression {
 private:
-    std::string name;
+    Symbol name;
 
 public:
-    explicit NamedReference(std::string name) : name(std::move(name)) {}
+    explicit NamedReference(Symbol name) : name(name) {}
+    explicit NamedReference(const std::string& name) : name(internSymbol(name)) {}
     
     void accept(IVisitor& visitor) override;
     
-    std::shared_ptr<Expression> clone() const override {
-        return std::make_shared<NamedReference>(name);
+    const std::string& getName() const {
+        return getSymbolName(name);
     }
     
-    std::string toString() const override {
-        return name;  // Just show the name
+    Symbol getSymbol() const {
+        return name;
     }
+};
+
+// Integer literal expression (a natural number, equal to its Church numeral)
+class IntegerLiteral : public Expression {
+private:
+    std::size_t value;
+
+public:
+    explicit IntegerLiteral(std::size_t value) : value(value) {}
     
-    const std::string& getName() const {
-        return name;
+    void accept(IVisitor& visitor) override;
+    
+    std::size_t getValue() const {
+        return value;
     }
 };
\ No newline at end of file
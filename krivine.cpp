@@ -0,0 +1,173 @@
+#include "krivine.h"
+#include "arena.h"
+#include <vector>
+
+namespace {
+
+struct Binding;
+
+// A term together with the environment giving its bound variables their values.
+// Closures without a term stand for the variable bound by the level-th
+// lambda entered during read back. Under call-by-need a closure is a thunk
+// and is overwritten with its value once forced.
+struct Closure {
+    TermPtr term;
+    const Binding* environment;
+    std::size_t level;
+};
+
+// Environments are immutable linked lists, innermost binding first, so
+// closures can share them freely
+struct Binding {
+    Closure* value;
+    const Binding* next;
+};
+
+enum class FrameKind {
+    Argument,       // Closure waiting to be applied by the head
+    Function,       // Read back function waiting for its read back argument
+    Abstraction,    // Lambda waiting for its read back body
+    Update          // Thunk to overwrite with the value being computed
+};
+
+struct Frame {
+    FrameKind kind;
+    Closure* closure;           // Argument, Update
+    TermPtr term;               // Function: read back function; Abstraction: the lambda
+};
+
+// Find the closure bound to a De Bruijn index
+Closure* lookup(const Binding* environment, std::size_t index) {
+    for (std::size_t i = 0; i < index; ++i) {
+        environment = environment->next;
+    }
+    return environment->value;
+}
+
+}
+
+TermPtr KrivineMachine::normalize(TermPtr start) {
+    TermArena& terms = context.getArena();
+    
+    // Closures and environments are only needed while the machine runs
+    Arena machine;
+    MachineNodeCounter machineNodes(context);
+    
+    std::vector<Frame> stack;
+    TermPtr term = start;
+    const Binding* environment = nullptr;
+    std::size_t depth = 0;
+    
+    while (true) {
+        // Run the machine until the head is stuck
+        TermPtr head = nullptr;
+        while (!head) {
+            machineNodes.update(machine.getAllocationCount() + stack.size());
+            switch (term->kind) {
+                case TermKind::Application: {
+                    // A variable argument shares the closure it is bound to
+                    Closure* argument = term->right->kind == TermKind::Bound
+                        ? lookup(environment, term->right->index)
+                        : machine.create<Closure>(Closure{term->right, environment, 0});
+                    stack.push_back({FrameKind::Argument, argument, nullptr});
+                    term = term->left;
+                    break;
+                }
+                
+                case TermKind::Abstraction:
+                    // A value has been reached: update the thunks that were waiting for it
+                    while (!stack.empty() && stack.back().kind == FrameKind::Update) {
+                        stack.back().closure->term = term;
+                        stack.back().closure->environment = environment;
+                        stack.pop_back();
+                    }
+                    if (!stack.empty() && stack.back().kind == FrameKind::Argument) {
+                        // Bind the argument closure instead of substituting it
+                        context.countStep(StepKind::Beta, 0, term);
+                        environment = machine.create<Binding>(Binding{stack.back().closure, environment});
+                        stack.pop_back();
+                    } else {
+                        // Weak head normal form: read back the body under a fresh variable
+                        auto variable = machine.create<Closure>(Closure{nullptr, nullptr, depth++});
+                        environment = machine.create<Binding>(Binding{variable, environment});
+                        stack.push_back({FrameKind::Abstraction, nullptr, term});
+                    }
+                    term = term->left;
+                    break;
+                
+                case TermKind::Bound: {
+                    Closure* closure = lookup(environment, term->index);
+                    if (closure->term) {
+                        if (callByNeed && closure->term->kind != TermKind::Abstraction) {
+                            stack.push_back({FrameKind::Update, closure, nullptr});
+                        }
+                        term = closure->term;
+                        environment = closure->environment;
+                    } else {
+                        // Thunks that evaluate to a read back variable become that variable
+                        while (!stack.empty() && stack.back().kind == FrameKind::Update) {
+                            *stack.back().closure = *closure;
+                            stack.pop_back();
+                        }
+                        // Convert the binding level back into an index
+                        head = terms.makeBound(depth - 1 - closure->level);
+                    }
+                    break;
+                }
+                
+                case TermKind::Reference: {
+                    auto definition = context.lookupDefinition(term->name);
+                    if (definition) {
+                        context.countStep(StepKind::Delta, term->name, definition);
+                        term = definition;
+                        environment = nullptr;
+                    } else {
+                        head = term;
+                    }
+                    break;
+                }
+                
+                default:
+                    head = term;
+                    break;
+            }
+        }
+        
+        // Rebuild outwards, reading back the pending arguments
+        bool resumed = false;
+        while (!stack.empty() && !resumed) {
+            Frame frame = stack.back();
+            stack.pop_back();
+            
+            switch (frame.kind) {
+                case FrameKind::Argument:
+                    stack.push_back({FrameKind::Function, nullptr, head});
+                    if (!frame.closure->term) {
+                        // Shared thunk that turned out to be a read back variable
+                        head = terms.makeBound(depth - 1 - frame.closure->level);
+                        break;
+                    }
+                    term = frame.closure->term;
+                    environment = frame.closure->environment;
+                    resumed = true;
+                    break;
+                case FrameKind::Function:
+                    head = terms.makeApplication(frame.term, head);
+                    break;
+                case FrameKind::Abstraction:
+                    head = terms.makeAbstraction(frame.term->name, head);
+                    --depth;
+                    break;
+                case FrameKind::Update:
+                    // Stuck applications depend on the read back depth, so the
+                    // thunk keeps its original closure
+                    break;
+            }
+        }
+        
+        if (!resumed) {
+            context.countMachineNodes(machine.getAllocationCount());
+            return head;
+        }
+    }
+}
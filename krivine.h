@@ -0,0 +1,27 @@
+#pragma once
+
+#include "debruijn.h"
+#include "reduction.h"
+
+// Call-by-name evaluation on a Krivine abstract machine.
+// Arguments are passed as closures (a term and the environment it was
+// found in) instead of being substituted, so reduction never copies or
+// rebuilds terms. After weak head normal form is reached the machine
+// continues under each lambda with a fresh neutral variable, which reads
+// the result back as a full normal form.
+//
+// With call-by-need enabled the closures become shared thunks: the first
+// time one is forced it is overwritten with its weak head normal form, so
+// an argument used several times is only reduced once.
+class KrivineMachine {
+private:
+    IReductionContext& context;
+    bool callByNeed;
+
+public:
+    explicit KrivineMachine(IReductionContext& context, bool callByNeed = false)
+        : context(context), callByNeed(callByNeed) {}
+    
+    // Reduce a closed-over term to normal form
+    TermPtr normalize(TermPtr term);
+};
@@ -0,0 +1,323 @@
+#include "lazy.h"
+#include "native.h"
+#include "normalorder.h"
+#include <algorithm>
+#include <limits>
+
+std::string getHeadFormName(HeadForm form) {
+    return form == HeadForm::WeakHead ? "whnf" : "hnf";
+}
+
+bool parseHeadForm(const std::string& name, HeadForm& form) {
+    for (auto candidate : {HeadForm::WeakHead, HeadForm::Head}) {
+        if (getHeadFormName(candidate) == name) {
+            form = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Index of no node
+static constexpr std::size_t noNode = std::numeric_limits<std::size_t>::max();
+
+// A term reduced to its head form, split into the head and the subterms
+// below it, which are replaced by their own nodes as they are expanded
+struct LazyNode {
+    std::size_t parent;                 // Node this is a subterm of, or noNode
+    std::vector<Symbol> parameters;     // Hints of the leading abstractions
+    TermPtr head;                       // Head of the spine, or null if the only subterm is the body of the abstraction
+    std::vector<TermPtr> subterms;      // Unreduced, in order
+    std::vector<std::size_t> expanded;  // Node of each subterm, or noNode
+    std::size_t placeholder;            // Number of the placeholder of the first subterm
+    TermPtr normalForm = nullptr;       // Set once normalized
+};
+
+// State shared by a lazy result and the handles to its subterms. Nodes are
+// kept in one vector and refer to each other by index, so a long chain of
+// expanded subterms is released without recursion.
+class LazyResult::Session : public IReductionContext {
+public:
+    Environment& environment;
+    HeadForm form;
+    EvaluationLimits limits;
+    bool nativeArithmetic;
+    
+    TermArena arena;
+    DefinitionCache definitions;
+    NativeRecognizer natives{arena};
+    std::vector<TermPtr> engineDefinitions;
+    std::size_t environmentChanges;     // Length of the environment's log of changes when the caches were filled
+    
+    LimitMonitor monitor;
+    EvaluationStats stats;
+    std::size_t operationSteps = 0;     // Steps taken before the current operation
+    
+    std::vector<LazyNode> nodes;
+    
+    // Node and subterm index of each placeholder, by number from one
+    std::vector<std::pair<std::size_t, std::size_t>> placeholders;
+    
+    Session(Environment& environment, HeadForm form, const EvaluationLimits& limits, bool nativeArithmetic,
+            std::size_t normalizeLimit)
+        : environment(environment), form(form), limits(limits), nativeArithmetic(nativeArithmetic),
+          definitions(environment, arena, normalizeLimit, &monitor), environmentChanges(environment.getChanges().size()) {}
+    
+    TermArena& getArena() override { return arena; }
+    
+    TermPtr lookupDefinition(Symbol name) override {
+        if (name < engineDefinitions.size() && engineDefinitions[name]) {
+            return engineDefinitions[name];
+        }
+        
+        TermPtr definition = definitions.lookup(name);
+        if (!definition) {
+            return nullptr;
+        }
+        if (name >= engineDefinitions.size()) {
+            engineDefinitions.resize(name + 1, nullptr);
+        }
+        engineDefinitions[name] = nativeArithmetic ? natives.recognize(definition)
+                                                   : expandNatives(arena, definition, [this](std::size_t nodes) { checkNodes(nodes); });
+        return engineDefinitions[name];
+    }
+    
+    void countStep(StepKind kind, Symbol, TermPtr) override {
+        if (kind == StepKind::Beta) {
+            ++stats.betaSteps;
+        } else {
+            ++stats.deltaSteps;
+        }
+        std::size_t steps = stats.betaSteps + stats.deltaSteps;
+        monitor.check(steps - operationSteps, arena.getNodeCount(), steps % 1024 == 0);
+    }
+    
+    // Lazy results are reduced in normal order, which holds no machine objects
+    void countMachineNodes(std::size_t) override {}
+    
+    // Check the limits before native integers are expanded into Church numerals
+    void checkNodes(std::size_t nodes) {
+        monitor.checkNumeral(stats.betaSteps + stats.deltaSteps - operationSteps, arena.getNodeCount(), nodes);
+    }
+    
+    // Expand the native integers of a term outside of a reduction, under
+    // limits of its own
+    TermPtr expand(TermPtr term) {
+        operationSteps = stats.betaSteps + stats.deltaSteps;
+        monitor.begin(limits);
+        return expandNatives(arena, term, [this](std::size_t nodes) { checkNodes(nodes); });
+    }
+    
+    // Run one reduction under the limits, adding its counters to the totals
+    template <typename Reduce>
+    TermPtr run(Reduce reduce) {
+        // Definitions converted before may have changed between operations
+        if (environment.getChanges().size() != environmentChanges) {
+            definitions.clear();
+            engineDefinitions.clear();
+            environmentChanges = environment.getChanges().size();
+        }
+        operationSteps = stats.betaSteps + stats.deltaSteps;
+        stats.stopReason.clear();
+        monitor.begin(limits);
+        try {
+            TermPtr term = reduce();
+            finish();
+            return term;
+        } catch (const LimitExceededError& error) {
+            stats.stopReason = error.what();
+            finish();
+            throw;
+        } catch (...) {
+            finish();
+            throw;
+        }
+    }
+    
+    void finish() {
+        stats.nodesAllocated = arena.getNodeCount();
+        stats.peakTermSize = std::max(stats.peakTermSize, arena.getPeakSize());
+        stats.elapsed += monitor.elapsed();
+    }
+    
+    // Reduce a term to the head form and add its node
+    std::size_t addNode(TermPtr term, std::size_t parent) {
+        term = run([&]() {
+            NormalOrderReducer reducer(*this);
+            return form == HeadForm::WeakHead ? reducer.reduceToWeakHeadNormalForm(term)
+                                              : reducer.reduceToHeadNormalForm(term);
+        });
+        
+        LazyNode node{parent, {}, nullptr, {}, {}, 0};
+        if (form == HeadForm::WeakHead && term->kind == TermKind::Abstraction) {
+            node.parameters.push_back(term->name);
+            node.subterms.push_back(term->left);
+        } else {
+            for (; term->kind == TermKind::Abstraction; term = term->left) {
+                node.parameters.push_back(term->name);
+            }
+            for (; term->kind == TermKind::Application; term = term->left) {
+                node.subterms.push_back(term->right);
+            }
+            std::reverse(node.subterms.begin(), node.subterms.end());
+            node.head = term;
+        }
+        node.expanded.assign(node.subterms.size(), noNode);
+        node.placeholder = placeholders.size() + 1;
+        for (std::size_t i = 0; i < node.subterms.size(); ++i) {
+            placeholders.emplace_back(nodes.size(), i);
+        }
+        nodes.push_back(std::move(node));
+        return nodes.size() - 1;
+    }
+    
+    // The term of a node as reduced so far. Subterms that are not expanded
+    // are left as they are, or with placeholders replaced by a free
+    // variable named after the number of the placeholder. Uses an explicit
+    // stack, as chains of expanded subterms can be long.
+    TermPtr compose(std::size_t root, bool placeholders) {
+        std::vector<std::pair<std::size_t, bool>> stack{{root, false}};
+        std::vector<TermPtr> results;
+        
+        while (!stack.empty()) {
+            auto [index, childrenDone] = stack.back();
+            stack.pop_back();
+            const LazyNode& node = nodes[index];
+            
+            if (node.normalForm) {
+                results.push_back(node.normalForm);
+                continue;
+            }
+            
+            if (!childrenDone) {
+                stack.push_back({index, true});
+                for (std::size_t i = node.subterms.size(); i > 0; --i) {
+                    if (node.expanded[i - 1] != noNode) {
+                        stack.push_back({node.expanded[i - 1], false});
+                    }
+                }
+                continue;
+            }
+            
+            // The expanded subterms are on top of the results, the first one deepest
+            std::size_t count = std::count_if(node.expanded.begin(), node.expanded.end(), [](std::size_t child) {
+                return child != noNode;
+            });
+            std::size_t next = results.size() - count;
+            std::vector<TermPtr> parts;
+            for (std::size_t i = 0; i < node.subterms.size(); ++i) {
+                if (node.expanded[i] != noNode) {
+                    parts.push_back(results[next++]);
+                } else if (placeholders) {
+                    parts.push_back(arena.makeFree(internSymbol("#" + std::to_string(node.placeholder + i))));
+                } else {
+                    parts.push_back(node.subterms[i]);
+                }
+            }
+            results.resize(results.size() - count);
+            
+            TermPtr term = node.head ? node.head : parts.front();
+            if (node.head) {
+                for (TermPtr part : parts) {
+                    term = arena.makeApplication(term, part);
+                }
+            }
+            for (std::size_t i = node.parameters.size(); i > 0; --i) {
+                term = arena.makeAbstraction(node.parameters[i - 1], term);
+            }
+            results.push_back(term);
+        }
+        return results.back();
+    }
+};
+
+LazyResult LazyResult::evaluate(Environment& environment, const std::shared_ptr<Expression>& expr, HeadForm form,
+                                const EvaluationLimits& limits, bool nativeArithmetic, std::size_t normalizeLimit) {
+    auto session = std::make_shared<Session>(environment, form, limits, nativeArithmetic, normalizeLimit);
+    TermPtr term = toDeBruijn(session->arena, *expr);
+    term = nativeArithmetic ? session->natives.recognize(term) : session->expand(term);
+    std::size_t root = session->addNode(term, noNode);
+    return LazyResult(session, root);
+}
+
+HeadForm LazyResult::getForm() const {
+    return session->form;
+}
+
+std::size_t LazyResult::getSubtermCount() const {
+    const LazyNode& current = session->nodes[node];
+    return current.normalForm ? 0 : current.subterms.size();
+}
+
+bool LazyResult::isExpanded(std::size_t index) const {
+    return index < getSubtermCount() && session->nodes[node].expanded[index] != noNode;
+}
+
+LazyResult LazyResult::expand(std::size_t index) {
+    if (index >= getSubtermCount()) {
+        throw EvaluationError("No subterm " + std::to_string(index + 1) + " to expand");
+    }
+    
+    std::size_t child = session->nodes[node].expanded[index];
+    if (child == noNode) {
+        // Adding the node may move the vector, so the subterm is read first
+        child = session->addNode(session->nodes[node].subterms[index], node);
+        session->nodes[node].expanded[index] = child;
+    }
+    return LazyResult(session, child);
+}
+
+LazyResult LazyResult::expandPlaceholder(std::size_t number) {
+    if (number == 0 || number > session->placeholders.size()) {
+        throw EvaluationError("No subterm #" + std::to_string(number) + " to expand");
+    }
+    auto [parent, index] = session->placeholders[number - 1];
+    if (session->nodes[parent].normalForm) {
+        throw EvaluationError("Subterm #" + std::to_string(number) + " is already normalized");
+    }
+    return LazyResult(session, parent).expand(index);
+}
+
+void LazyResult::normalize() {
+    if (isNormalForm()) {
+        return;
+    }
+    
+    TermPtr term = session->compose(node, false);
+    TermPtr normalForm = session->run([&]() {
+        NormalOrderReducer reducer(*session);
+        return reducer.normalize(term);
+    });
+    session->nodes[node].normalForm = normalForm;
+}
+
+bool LazyResult::isNormalForm() const {
+    return session->nodes[node].normalForm != nullptr;
+}
+
+std::shared_ptr<Expression> LazyResult::toExpression() const {
+    TermArena& arena = session->arena;
+    TermPtr term = session->expand(session->compose(node, true));
+    
+    // A subterm refers to the parameters of the nodes above it. They are
+    // bound again around it, so they get names, and removed after naming.
+    std::size_t binders = 0;
+    for (std::size_t parent = session->nodes[node].parent; parent != noNode; parent = session->nodes[parent].parent) {
+        const auto& parameters = session->nodes[parent].parameters;
+        for (std::size_t i = parameters.size(); i > 0; --i) {
+            term = arena.makeAbstraction(parameters[i - 1], term);
+            ++binders;
+        }
+    }
+    
+    auto expr = fromDeBruijn(term, &session->stats.renames);
+    for (std::size_t i = 0; i < binders; ++i) {
+        auto body = std::static_pointer_cast<Abstraction>(expr)->getBody();
+        expr = body;
+    }
+    return expr;
+}
+
+const EvaluationStats& LazyResult::getStats() const {
+    return session->stats;
+}
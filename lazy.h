@@ -0,0 +1,82 @@
+#pragma once
+
+#include "expression.h"
+#include "environment.h"
+#include "reduction.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// How far a lazy evaluation reduces a term before it stops
+enum class HeadForm {
+    WeakHead,       // Until it is an abstraction or a variable applied to arguments
+    Head            // Also under the leading abstractions, until the head of the body is a variable
+};
+
+// Name used for a head form in the REPL
+std::string getHeadFormName(HeadForm form);
+
+// Look up a head form by its name; returns false if the name is unknown
+bool parseHeadForm(const std::string& name, HeadForm& form);
+
+// Result of a lazy evaluation: a term reduced by normal order only as far
+// as its head form, with the subterms below the head (the arguments of the
+// head, or the body of an abstraction in weak head normal form) left as
+// they are until they are expanded. The work done is proportional to the
+// part of the result that is inspected.
+//
+// A result owns its evaluation: an arena for its terms and its limits, so
+// it stays valid while other evaluations run. It refers to the environment,
+// which must outlive it: like a name in any other expression, a definition
+// is looked up when a subterm using it is reduced, and its normal form is
+// memoized there as in other evaluations. The handles returned for
+// subterms share that state; the limits apply to each evaluation,
+// expansion or normalization separately.
+class LazyResult {
+private:
+    class Session;
+    
+    std::shared_ptr<Session> session;
+    std::size_t node;
+    
+    LazyResult(std::shared_ptr<Session> session, std::size_t node)
+        : session(std::move(session)), node(node) {}
+
+public:
+    // Reduce an expression to a head form against an environment. Definitions
+    // are memoized within normalizeLimit steps, as by DefinitionCache.
+    static LazyResult evaluate(Environment& environment, const std::shared_ptr<Expression>& expr, HeadForm form,
+                               const EvaluationLimits& limits = {}, bool nativeArithmetic = false,
+                               std::size_t normalizeLimit = 0);
+    
+    HeadForm getForm() const;
+    
+    // Number of subterms below the head; zero once normalized
+    std::size_t getSubtermCount() const;
+    
+    // Whether a subterm has been reduced to its head form
+    bool isExpanded(std::size_t index) const;
+    
+    // Reduce a subterm to the same head form. The reduced subterm replaces
+    // the original in this result, so expanding it again does no work.
+    LazyResult expand(std::size_t index);
+    
+    // Expand the subterm shown as the placeholder #number by toExpression
+    // of this or any other handle of the same result
+    LazyResult expandPlaceholder(std::size_t number);
+    
+    // Reduce this term, with everything below it, to normal form. Handles
+    // to subterms expanded before stay valid but are no longer part of it.
+    void normalize();
+    
+    bool isNormalForm() const;
+    
+    // The term as reduced so far. Each subterm that is not expanded is shown
+    // as a free variable such as #3, numbered from one in the order the
+    // subterms were reached, so the numbers stay the same as it is expanded.
+    std::shared_ptr<Expression> toExpression() const;
+    
+    // Counters summed over the evaluation and every expansion of the result
+    const EvaluationStats& getStats() const;
+};
@@ -0,0 +1,76 @@
+#include "lexer.h"
+
+static bool isWhitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+static bool isIdentifierStart(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool isIdentifierPart(char c) {
+    return isIdentifierStart(c) || isDigit(c);
+}
+
+// Length of the UTF-8 sequence starting with the given byte, so invalid
+// characters are reported whole
+static std::size_t sequenceLength(unsigned char lead) {
+    if (lead >= 0xF0) return 4;
+    if (lead >= 0xE0) return 3;
+    if (lead >= 0xC0) return 2;
+    return 1;
+}
+
+Token Lexer::next() {
+    while (position < input.size() && isWhitespace(input[position])) {
+        position++;
+    }
+    
+    std::size_t start = position;
+    if (position >= input.size()) {
+        return Token{TokenKind::End, input.substr(start, 0), start};
+    }
+    
+    char c = input[position];
+    TokenKind kind = TokenKind::Invalid;
+    std::size_t length = 1;
+    
+    if (isIdentifierStart(c)) {
+        while (start + length < input.size() && isIdentifierPart(input[start + length])) {
+            length++;
+        }
+        kind = TokenKind::Identifier;
+    } else if (isDigit(c)) {
+        while (start + length < input.size() && isDigit(input[start + length])) {
+            length++;
+        }
+        kind = TokenKind::Integer;
+    } else if (c == '\\') {
+        kind = TokenKind::Lambda;
+    } else if (input.compare(start, 2, "\xCE\xBB") == 0) {
+        kind = TokenKind::Lambda;
+        length = 2;
+    } else if (c == '.') {
+        kind = TokenKind::Dot;
+    } else if (c == '(') {
+        kind = TokenKind::LeftParen;
+    } else if (c == ')') {
+        kind = TokenKind::RightParen;
+    } else if (c == '=') {
+        kind = TokenKind::Equals;
+    } else {
+        length = sequenceLength(static_cast<unsigned char>(c));
+    }
+    
+    position = start + length > input.size() ? input.size() : start + length;
+    return Token{kind, input.substr(start, position - start), start};
+}
+
+Token Lexer::peek() const {
+    Lexer copy = *this;
+    return copy.next();
+}
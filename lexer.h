@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+// Kinds of tokens in lambda calculus source
+enum class TokenKind {
+    Identifier,     // Letter or '_', then letters, digits and '_'
+    Integer,        // Decimal digits
+    Lambda,         // '\' or the UTF-8 encoded 'λ'
+    Dot,
+    LeftParen,
+    RightParen,
+    Equals,
+    End,            // End of input
+    Invalid         // Any other character
+};
+
+// Token referring into the source text
+struct Token {
+    TokenKind kind;
+    std::string_view text;
+    std::size_t position;       // Byte offset in the source
+};
+
+// Splits source text into tokens in a single pass without copying it.
+// The source must outlive the lexer and its tokens.
+class Lexer {
+private:
+    std::string_view input;
+    std::size_t position = 0;
+
+public:
+    explicit Lexer(std::string_view input) : input(input) {}
+    
+    // Consume and return the next token, skipping whitespace
+    Token next();
+    
+    // Return the next token without consuming it
+    Token peek() const;
+};
@@ -1,82 +1,29 @@
 // main.cpp
-#include "Expression.h"
-#include "Visitor.h"
-#include "Evaluator.h"
-#include "Parser.h"
-#include "Environment.h"
+#include "expression.h"
+#include "visitor.h"
+#include "evaluator.h"
+#include "parser.h"
+#include "environment.h"
+#include "batch.h"
+#include "snapshot.h"
+#include "printer.h"
+#include "trace.h"
+#include "profiler.h"
 #include <iostream>
 #include <string>
 #include <memory>
-#include <regex>
-#include "Windows.h"
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <optional>
 
-// Class to print lambda expressions in a pretty format
-class PrettyPrinter : public IVisitor {
-private:
-    std::string result;
-    const Environment& environment;
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
-public:
-    explicit PrettyPrinter(const Environment& env) : environment(env) {}
-
-    void visit(Variable& variable) override {
-        result = variable.getName();
-    }
-
-    void visit(Abstraction& abstraction) override {
-        result = "L" + abstraction.getParameter() + ".";
-        
-        // Use visitor to get body string
-        PrettyPrinter bodyPrinter(environment);
-        abstraction.getBody()->accept(bodyPrinter);
-        result += bodyPrinter.result;
-    }
-
-    void visit(Application& application) override {
-        // Use visitor to get function and argument strings
-        PrettyPrinter functionPrinter(environment);
-        PrettyPrinter argumentPrinter(environment);
-        
-        application.getFunction()->accept(functionPrinter);
-        application.getArgument()->accept(argumentPrinter);
-        
-        // Add parentheses around the application
-        result = "(" + functionPrinter.result + " " + argumentPrinter.result + ")";
-    }
-    
-    void visit(NamedReference& reference) override {
-        // For named references, just show the name
-        result = reference.getName();
-        
-        // Optionally, we could expand the reference to show its definition
-        // auto definition = environment.lookup(reference.getName());
-        // if (definition) {
-        //     definition->accept(*this);
-        // } else {
-        //     result = reference.getName();
-        // }
-    }
-
-    std::string toString(const std::shared_ptr<Expression>& expr) {
-        expr->accept(*this);
-        return result;
-    }
-};
-
-int main() {
-
-    SetConsoleOutputCP(CP_UTF8);
-    
-    std::cout << "Enhanced Lambda Calculus Interpreter" << std::endl;
-    std::cout << "==================================" << std::endl;
-    
-    // Create environment
-    Environment env;
-    
-    // Create evaluator with the environment
-    Evaluator evaluator(env);
-    
-    // Define Church numerals and operations
+// Church numerals, booleans and operations available in every session
+static void definePrelude(Environment& env, bool verbose) {
     std::vector<std::pair<std::string, std::string>> definitions = {
         {"zero", "\\f.\\x.x"},
         {"one", "\\f.\\x.f x"},
@@ -87,6 +34,8 @@ int main() {
         {"mult", "\\m.\\n.\\f.m (n f)"},
         {"pred", "\\n.\\f.\\x.n (\\g.\\h.h (g f)) (\\u.x) (\\u.u)"},
         {"iszero", "\\n.n (\\x.\\t.\\f.f) (\\t.\\f.t)"},
+        {"sub", "\\m.\\n.n pred m"},
+        {"leq", "\\m.\\n.iszero (sub m n)"},
         {"true", "\\t.\\f.t"},
         {"false", "\\t.\\f.f"},
         {"if", "\\p.\\a.\\b.p a b"},
@@ -99,13 +48,190 @@ int main() {
             Parser parser(exprStr, env);
             auto expr = parser.parse();
             env.define(name, expr);
-            std::cout << "Defined " << name << " = " << expr->toString() << std::endl;
+            if (verbose) {
+                std::cout << "Defined " << name << " = " << expr->toString() << std::endl;
+            }
         } catch (const ParserError& e) {
             std::cerr << "Parser error in definition of " << name << ": " << e.what() << std::endl;
         } catch (const std::exception& e) {
             std::cerr << "Error in definition of " << name << ": " << e.what() << std::endl;
         }
     }
+}
+
+static void printUsage() {
+    std::cerr << "Usage: lambda_calculus [--batch] [--jobs N] [--strategy NAME] [--native] [--trace FILE] [--load FILE] [--save FILE] [script...]" << std::endl;
+    std::cerr << "  With scripts or --batch, runs the scripts (or standard input) without" << std::endl;
+    std::cerr << "  interaction and prints one result line per expression." << std::endl;
+    std::cerr << "  --native evaluates integers and Church arithmetic natively." << std::endl;
+    std::cerr << "  --trace records every reduction step to a file, read by lambda_trace." << std::endl;
+    std::cerr << "  --load maps a snapshot saved before; --save writes the definitions" << std::endl;
+    std::cerr << "  and their normal forms to a snapshot after the scripts ran." << std::endl;
+}
+
+// Print a lazy result as reduced so far, with the steps spent on it
+static void printLazyResult(PrettyPrinter& printer, const LazyResult& result) {
+    const EvaluationStats& stats = result.getStats();
+    auto expr = result.toExpression();
+    std::cout << "Result: ";
+    printer.print(std::cout, *expr);
+    std::cout << std::endl;
+    std::cout << "Steps: " << stats.betaSteps + stats.deltaSteps << " (" << getHeadFormName(result.getForm()) << ")" << std::endl;
+}
+
+// Memoize the normal forms of all definitions and write them to a snapshot
+static bool saveEnvironment(Environment& env, Evaluator& evaluator, const std::string& path, std::ostream& log) {
+    try {
+        evaluator.normalizeDefinitions();
+        saveSnapshot(env, path);
+        log << "Saved " << env.size() << " definitions to " << path << std::endl;
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+static bool loadEnvironment(Environment& env, const std::string& path) {
+    try {
+        std::size_t count = loadSnapshot(env, path);
+        std::cout << "Loaded " << count << " definitions from " << path << std::endl;
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+// Run scripts, and standard input if asked, on a thread pool; then save a snapshot if a path is given
+static int runBatch(Environment& env, const std::vector<std::string>& scripts, bool standardInput,
+                    std::size_t jobs, Strategy strategy, bool native, Tracer* tracer, const std::string& savePath) {
+    std::size_t failures = 0;
+    {
+        BatchRunner runner(env, jobs);
+        runner.setStrategy(strategy);
+        runner.setNativeArithmetic(native);
+        runner.setTracer(tracer);
+    
+        if (standardInput) {
+            failures += runner.run(std::cin, std::cout, std::cerr);
+        }
+        for (const auto& script : scripts) {
+            std::ifstream file(script);
+            if (!file) {
+                std::cerr << "Cannot open '" << script << "'" << std::endl;
+                ++failures;
+                continue;
+            }
+            failures += runner.run(file, std::cout, std::cerr);
+        }
+    }
+    
+    if (!savePath.empty()) {
+        // Results go to standard output, so the confirmation goes to standard error
+        Evaluator evaluator(env);
+        failures += saveEnvironment(env, evaluator, savePath, std::cerr) ? 0 : 1;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+
+#ifdef _WIN32
+    SetConsoleOutputCP(CP_UTF8);
+#endif
+    
+    bool batch = false;
+    std::size_t jobs = 0;
+    Strategy strategy = Strategy::NormalOrder;
+    bool native = false;
+    std::vector<std::string> scripts;
+    std::vector<std::string> snapshots;
+    std::string savePath;
+    std::string tracePath;
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        
+        if (argument == "--batch") {
+            batch = true;
+        } else if (argument == "--jobs" && hasValue) {
+            jobs = static_cast<std::size_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (argument == "--strategy" && hasValue) {
+            if (!parseStrategy(argv[++i], strategy)) {
+                std::cerr << "Unknown strategy '" << argv[i] << "'" << std::endl;
+                return 1;
+            }
+        } else if (argument == "--native") {
+            native = true;
+        } else if (argument == "--trace" && hasValue) {
+            tracePath = argv[++i];
+        } else if (argument == "--load" && hasValue) {
+            snapshots.push_back(argv[++i]);
+        } else if (argument == "--save" && hasValue) {
+            savePath = argv[++i];
+        } else if (argument.empty() || argument[0] == '-') {
+            printUsage();
+            return 1;
+        } else {
+            scripts.push_back(argument);
+        }
+    }
+    
+    // The trace is finished when it is destroyed, after the last evaluation
+    std::unique_ptr<Tracer> tracer;
+    if (!tracePath.empty()) {
+        try {
+            tracer = std::make_unique<Tracer>(tracePath);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    
+    // Create environment
+    Environment env;
+    
+    if (batch || !scripts.empty() || !savePath.empty()) {
+        definePrelude(env, false);
+        for (const auto& snapshot : snapshots) {
+            try {
+                loadSnapshot(env, snapshot);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+                return 1;
+            }
+        }
+        return runBatch(env, scripts, batch && scripts.empty(), jobs, strategy, native, tracer.get(), savePath);
+    }
+    
+    std::cout << "Enhanced Lambda Calculus Interpreter" << std::endl;
+    std::cout << "==================================" << std::endl;
+    
+    // Create evaluator with the environment
+    Evaluator evaluator(env);
+    evaluator.setStrategy(strategy);
+    evaluator.setNativeArithmetic(native);
+    evaluator.setTracer(tracer.get());
+    
+    // Results are printed with the options of :print, naming the definitions they equal
+    PrettyPrinter printer(PrintOptions{}, &env);
+    
+    // With :form whnf or hnf, expressions are only reduced to their head;
+    // :expand and :normalize then work on the last result
+    bool lazy = false;
+    HeadForm headForm = HeadForm::Head;
+    std::optional<LazyResult> lazyResult;
+    
+    // Costs of the evaluations since :profile on, kept after :profile off
+    std::unique_ptr<Profiler> profiler;
+    
+    // Define Church numerals and operations
+    definePrelude(env, true);
+    for (const auto& snapshot : snapshots) {
+        loadEnvironment(env, snapshot);
+    }
     
     // Interactive mode
     std::cout << "\nInteractive Mode" << std::endl;
@@ -115,15 +241,26 @@ int main() {
     std::cout << "  expression          Evaluate an expression" << std::endl;
     std::cout << "  :quit or :exit      Exit the interpreter" << std::endl;
     std::cout << "  :defs               Show all definitions" << std::endl;
+    std::cout << "  :strategy [name]    Show or set the strategy (normal, name, need, applicative, nbe, parallel, vm)" << std::endl;
+    std::cout << "  :memo [steps]       Show or set the step limit for memoizing definitions (0 disables)" << std::endl;
+    std::cout << "  :limit [kind n]     Show or set a limit: steps, time (ms) or nodes (0 = none)" << std::endl;
+    std::cout << "  :stats              Show statistics of the last evaluation" << std::endl;
+    std::cout << "  :native [on|off]    Show or set native integer arithmetic" << std::endl;
+    std::cout << "  :print [option n]   Show or set printing: depth, size, share (0 = off) or names (on|off)" << std::endl;
+    std::cout << "  :form [name]        Show or set how far results are reduced (normal, whnf, hnf)" << std::endl;
+    std::cout << "  :expand n           Reduce the subterm shown as #n in the last whnf or hnf result" << std::endl;
+    std::cout << "  :normalize [n]      Reduce the last whnf or hnf result, or its subterm #n, to normal form" << std::endl;
+    std::cout << "  :trace [file|off]   Show, start or stop recording every reduction step to a trace file" << std::endl;
+    std::cout << "  :profile [command]  Show the profile, or on, off, reset, or export file [steps|nodes|time]" << std::endl;
+    std::cout << "  :save file          Save all definitions and their normal forms to a snapshot" << std::endl;
+    std::cout << "  :load file          Load the definitions of a snapshot" << std::endl;
     std::cout << "  :help               Show this help message" << std::endl;
     
     std::string line;
     
     while (true) {
         std::cout << "\n> ";
-        std::getline(std::cin, line);
-        
-        if (line == ":quit" || line == ":exit") {
+        if (!std::getline(std::cin, line) || line == ":quit" || line == ":exit") {
             break;
         }
         
@@ -133,6 +270,19 @@ int main() {
             std::cout << "  expression          Evaluate an expression" << std::endl;
             std::cout << "  :quit or :exit      Exit the interpreter" << std::endl;
             std::cout << "  :defs               Show all definitions" << std::endl;
+            std::cout << "  :strategy [name]    Show or set the strategy (normal, name, need, applicative, nbe, parallel, vm)" << std::endl;
+            std::cout << "  :memo [steps]       Show or set the step limit for memoizing definitions (0 disables)" << std::endl;
+            std::cout << "  :limit [kind n]     Show or set a limit: steps, time (ms) or nodes (0 = none)" << std::endl;
+            std::cout << "  :stats              Show statistics of the last evaluation" << std::endl;
+            std::cout << "  :native [on|off]    Show or set native integer arithmetic" << std::endl;
+            std::cout << "  :print [option n]   Show or set printing: depth, size, share (0 = off) or names (on|off)" << std::endl;
+            std::cout << "  :form [name]        Show or set how far results are reduced (normal, whnf, hnf)" << std::endl;
+            std::cout << "  :expand n           Reduce the subterm shown as #n in the last whnf or hnf result" << std::endl;
+            std::cout << "  :normalize [n]      Reduce the last whnf or hnf result, or its subterm #n, to normal form" << std::endl;
+            std::cout << "  :trace [file|off]   Show, start or stop recording every reduction step to a trace file" << std::endl;
+            std::cout << "  :profile [command]  Show the profile, or on, off, reset, or export file [steps|nodes|time]" << std::endl;
+            std::cout << "  :save file          Save all definitions and their normal forms to a snapshot" << std::endl;
+            std::cout << "  :load file          Load the definitions of a snapshot" << std::endl;
             std::cout << "  :help               Show this help message" << std::endl;
             continue;
         }
@@ -142,6 +292,264 @@ int main() {
             continue;
         }
         
+        if (line.rfind(":strategy", 0) == 0) {
+            std::string name = line.substr(9);
+            name.erase(0, name.find_first_not_of(" \t"));
+            name.erase(name.find_last_not_of(" \t") + 1);
+            
+            Strategy strategy;
+            if (name.empty()) {
+                std::cout << "Strategy: " << getStrategyName(evaluator.getStrategy()) << std::endl;
+            } else if (parseStrategy(name, strategy)) {
+                evaluator.setStrategy(strategy);
+                std::cout << "Strategy set to " << name << std::endl;
+            } else {
+                std::cerr << "Unknown strategy '" << name << "' (expected normal, name, need, applicative, nbe, parallel or vm)" << std::endl;
+            }
+            continue;
+        }
+        
+        if (line == ":stats") {
+            const EvaluationStats& stats = evaluator.getStats();
+            std::cout << "Beta steps:      " << stats.betaSteps << std::endl;
+            std::cout << "Delta steps:     " << stats.deltaSteps << std::endl;
+            std::cout << "Alpha renames:   " << stats.renames << std::endl;
+            std::cout << "Nodes allocated: " << stats.nodesAllocated << std::endl;
+            std::cout << "Peak term size:  " << stats.peakTermSize << std::endl;
+            std::cout << "Machine nodes:   " << stats.machineNodes << std::endl;
+            std::cout << "Time:            " << stats.elapsed.count() / 1000.0 << " ms" << std::endl;
+            if (!stats.stopReason.empty()) {
+                std::cout << "Stopped:         " << stats.stopReason << std::endl;
+            }
+            continue;
+        }
+        
+        if (line.rfind(":limit", 0) == 0) {
+            std::istringstream arguments(line.substr(6));
+            std::string kind;
+            std::string value;
+            arguments >> kind >> value;
+            
+            EvaluationLimits limits = evaluator.getLimits();
+            bool valid = !value.empty() && value.find_first_not_of("0123456789") == std::string::npos && value.size() < 19;
+            if (kind.empty()) {
+                std::cout << "Steps: " << limits.maxSteps << std::endl;
+                std::cout << "Time:  " << limits.maxTime.count() << " ms" << std::endl;
+                std::cout << "Nodes: " << limits.maxNodes << std::endl;
+            } else if (valid && kind == "steps") {
+                limits.maxSteps = std::stoull(value);
+            } else if (valid && kind == "time") {
+                limits.maxTime = std::chrono::milliseconds(std::stoll(value));
+            } else if (valid && kind == "nodes") {
+                limits.maxNodes = std::stoull(value);
+            } else {
+                std::cerr << "Usage: :limit [steps|time|nodes value]" << std::endl;
+                continue;
+            }
+            
+            if (!kind.empty()) {
+                evaluator.setLimits(limits);
+                std::cout << "Limit on " << kind << " set to " << value << std::endl;
+            }
+            continue;
+        }
+        
+        if (line.rfind(":print", 0) == 0) {
+            std::istringstream arguments(line.substr(6));
+            std::string option;
+            std::string value;
+            arguments >> option >> value;
+            
+            PrintOptions options = printer.getOptions();
+            bool valid = !value.empty() && value.find_first_not_of("0123456789") == std::string::npos && value.size() < 19;
+            if (option.empty()) {
+                std::cout << "Depth: " << options.maxDepth << std::endl;
+                std::cout << "Size:  " << options.maxSize << std::endl;
+                std::cout << "Share: " << options.shareSize << std::endl;
+                std::cout << "Names: " << (options.names ? "on" : "off") << std::endl;
+            } else if (valid && option == "depth") {
+                options.maxDepth = std::stoull(value);
+            } else if (valid && option == "size") {
+                options.maxSize = std::stoull(value);
+            } else if (valid && option == "share") {
+                options.shareSize = std::stoull(value);
+            } else if (option == "names" && (value == "on" || value == "off")) {
+                options.names = value == "on";
+            } else {
+                std::cerr << "Usage: :print [depth|size|share n] [names on|off]" << std::endl;
+                continue;
+            }
+            
+            if (!option.empty()) {
+                printer.setOptions(options);
+                std::cout << "Printing " << option << " set to " << value << std::endl;
+            }
+            continue;
+        }
+        
+        if (line.rfind(":native", 0) == 0) {
+            std::string mode = line.substr(7);
+            mode.erase(0, mode.find_first_not_of(" \t"));
+            mode.erase(mode.find_last_not_of(" \t") + 1);
+            
+            if (mode.empty()) {
+                std::cout << "Native arithmetic: " << (evaluator.getNativeArithmetic() ? "on" : "off") << std::endl;
+            } else if (mode == "on" || mode == "off") {
+                evaluator.setNativeArithmetic(mode == "on");
+                std::cout << "Native arithmetic " << mode << std::endl;
+            } else {
+                std::cerr << "Usage: :native [on|off]" << std::endl;
+            }
+            continue;
+        }
+        
+        if (line.rfind(":form", 0) == 0) {
+            std::string name = line.substr(5);
+            name.erase(0, name.find_first_not_of(" \t"));
+            name.erase(name.find_last_not_of(" \t") + 1);
+            
+            HeadForm form;
+            if (name.empty()) {
+                std::cout << "Form: " << (lazy ? getHeadFormName(headForm) : "normal") << std::endl;
+            } else if (name == "normal") {
+                lazy = false;
+                std::cout << "Form set to normal" << std::endl;
+            } else if (parseHeadForm(name, form)) {
+                lazy = true;
+                headForm = form;
+                std::cout << "Form set to " << name << std::endl;
+            } else {
+                std::cerr << "Unknown form '" << name << "' (expected normal, whnf or hnf)" << std::endl;
+            }
+            continue;
+        }
+        
+        if (line.rfind(":expand", 0) == 0 || line.rfind(":normalize", 0) == 0) {
+            bool normalize = line[1] == 'n';
+            std::string number = line.substr(normalize ? 10 : 7);
+            number.erase(0, number.find_first_not_of(" \t#"));
+            number.erase(number.find_last_not_of(" \t") + 1);
+            
+            bool valid = !number.empty() && number.find_first_not_of("0123456789") == std::string::npos && number.size() < 19;
+            if (!lazyResult) {
+                std::cerr << "No result to expand; set :form whnf or hnf and evaluate an expression" << std::endl;
+            } else if (!valid && !(normalize && number.empty())) {
+                std::cerr << "Usage: :expand n or :normalize [n], for the subterm shown as #n" << std::endl;
+            } else {
+                try {
+                    LazyResult subterm = valid ? lazyResult->expandPlaceholder(std::stoull(number)) : *lazyResult;
+                    if (normalize) {
+                        subterm.normalize();
+                    }
+                    printLazyResult(printer, *lazyResult);
+                } catch (const std::exception& e) {
+                    std::cerr << "Error: " << e.what() << std::endl;
+                }
+            }
+            continue;
+        }
+        
+        if (line.rfind(":trace", 0) == 0) {
+            std::string path = line.substr(6);
+            path.erase(0, path.find_first_not_of(" \t"));
+            path.erase(path.find_last_not_of(" \t") + 1);
+            
+            if (path.empty()) {
+                if (tracer) {
+                    tracer->flush();
+                }
+                std::cout << "Trace: " << (tracer ? std::to_string(tracer->getWrittenCount()) + " records written" : "off") << std::endl;
+            } else if (path == "off") {
+                evaluator.setTracer(nullptr);
+                tracer.reset();
+                std::cout << "Trace off" << std::endl;
+            } else {
+                try {
+                    // The previous trace is finished before the new one starts
+                    evaluator.setTracer(nullptr);
+                    tracer.reset();
+                    tracer = std::make_unique<Tracer>(path);
+                    evaluator.setTracer(tracer.get());
+                    std::cout << "Tracing to " << path << std::endl;
+                } catch (const std::exception& e) {
+                    std::cerr << "Error: " << e.what() << std::endl;
+                }
+            }
+            continue;
+        }
+        
+        if (line.rfind(":profile", 0) == 0) {
+            std::istringstream arguments(line.substr(8));
+            std::string command;
+            std::string path;
+            std::string metricName = "steps";
+            arguments >> command >> path >> metricName;
+            
+            ProfileMetric metric;
+            if (command.empty()) {
+                if (profiler) {
+                    profiler->writeReport(std::cout);
+                } else {
+                    std::cout << "No profile; start one with :profile on" << std::endl;
+                }
+            } else if (command == "on") {
+                profiler = std::make_unique<Profiler>();
+                evaluator.setProfiler(profiler.get());
+                std::cout << "Profiling on" << std::endl;
+            } else if (command == "off") {
+                evaluator.setProfiler(nullptr);
+                std::cout << "Profiling off" << std::endl;
+            } else if (command == "reset") {
+                if (profiler) {
+                    profiler->clear();
+                }
+                std::cout << "Profile cleared" << std::endl;
+            } else if (command == "export" && !path.empty() && parseProfileMetric(metricName, metric)) {
+                if (!profiler) {
+                    std::cerr << "No profile; start one with :profile on" << std::endl;
+                } else if (std::ofstream file(path); !file) {
+                    std::cerr << "Cannot create '" << path << "'" << std::endl;
+                } else {
+                    profiler->writeCollapsedStacks(file, metric);
+                    std::cout << "Wrote collapsed stacks of " << metricName << " to " << path << std::endl;
+                }
+            } else {
+                std::cerr << "Usage: :profile [on|off|reset|export file [steps|nodes|time]]" << std::endl;
+            }
+            continue;
+        }
+        
+        if (line.rfind(":save", 0) == 0 || line.rfind(":load", 0) == 0) {
+            std::string path = line.substr(5);
+            path.erase(0, path.find_first_not_of(" \t"));
+            path.erase(path.find_last_not_of(" \t") + 1);
+            
+            if (path.empty()) {
+                std::cerr << "Usage: " << line.substr(0, 5) << " file" << std::endl;
+            } else if (line[1] == 's') {
+                saveEnvironment(env, evaluator, path, std::cout);
+            } else {
+                loadEnvironment(env, path);
+            }
+            continue;
+        }
+        
+        if (line.rfind(":memo", 0) == 0) {
+            std::string steps = line.substr(5);
+            steps.erase(0, steps.find_first_not_of(" \t"));
+            steps.erase(steps.find_last_not_of(" \t") + 1);
+            
+            if (steps.empty()) {
+                std::cout << "Definition step limit: " << evaluator.getDefinitionStepLimit() << std::endl;
+            } else if (steps.find_first_not_of("0123456789") == std::string::npos && steps.size() < 19) {
+                evaluator.setDefinitionStepLimit(std::stoull(steps));
+                std::cout << "Definition step limit set to " << steps << std::endl;
+            } else {
+                std::cerr << "Invalid step limit '" << steps << "'" << std::endl;
+            }
+            continue;
+        }
+        
         try {
             // Check if this is a definition
             std::string name;
@@ -157,11 +565,37 @@ int main() {
                 expr = parser.parse();
                 std::cout << "Parsed: " << expr->toString() << std::endl;
                 
-                auto result = evaluator.evaluateNormalOrder(expr);
-                std::cout << "Result: " << result->toString() << std::endl;
+                if (lazy) {
+                    lazyResult = evaluator.evaluateLazily(expr, headForm);
+                    printLazyResult(printer, *lazyResult);
+                    continue;
+                }
+                
+                lazyResult.reset();
+                auto result = evaluator.evaluate(expr);
+                std::cout << "Result: ";
+                printer.print(std::cout, *result);
+                std::cout << std::endl;
+                std::cout << "Steps: " << evaluator.getStepCount() << " (" << getStrategyName(evaluator.getStrategy()) << ")" << std::endl;
+                
+                auto names = printer.findDefinitions(*result);
+                if (!names.empty()) {
+                    std::cout << "This is equivalent to: ";
+                    for (std::size_t i = 0; i < names.size(); ++i) {
+                        std::cout << (i > 0 ? ", " : "") << getSymbolName(names[i]);
+                    }
+                    std::cout << std::endl;
+                }
             }
         } catch (const ParserError& e) {
             std::cerr << "Parser error: " << e.what() << std::endl;
+        } catch (const LimitExceededError& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            if (auto partial = evaluator.getPartialResult()) {
+                std::cout << "Partial result: ";
+                printer.print(std::cout, *partial);
+                std::cout << std::endl;
+            }
         } catch (const std::exception& e) {
             std::cerr << "Error: " << e.what() << std::endl;
         }
@@ -0,0 +1,220 @@
+#include "native.h"
+#include "environment.h"
+#include "parser.h"
+#include <cstdint>
+#include <memory>
+
+// Church encodings of the primitives, by Primitive, in the normal forms the
+// prelude definitions reduce to
+static const char* const encodingSources[] = {
+    "\\n.\\f.\\x.f (n f x)",
+    "\\n.\\f.\\x.n (\\g.\\h.h (g f)) (\\u.x) (\\u.u)",
+    "\\m.\\n.\\f.\\x.m f (n f x)",
+    "\\m.\\n.n (\\n.\\f.\\x.n (\\g.\\h.h (g f)) (\\u.x) (\\u.u)) m",
+    "\\m.\\n.\\f.m (n f)",
+    "\\n.n (\\x.\\t.\\f.f) (\\t.\\f.t)",
+    "\\m.\\n.n (\\n.\\f.\\x.n (\\g.\\h.h (g f)) (\\u.x) (\\u.u)) m (\\x.\\t.\\f.f) (\\t.\\f.t)"
+};
+
+// Parsed encodings, shared by every evaluation
+static const std::vector<std::shared_ptr<Expression>>& getEncodingExpressions() {
+    static const std::vector<std::shared_ptr<Expression>> expressions = [] {
+        Environment environment;
+        std::vector<std::shared_ptr<Expression>> parsed;
+        for (const char* source : encodingSources) {
+            parsed.push_back(Parser(source, environment).parse());
+        }
+        return parsed;
+    }();
+    return expressions;
+}
+
+// Rebuild a term, replacing each subterm for which replace returns a term
+// and descending into the others. Uses an explicit stack so deep terms do
+// not exhaust the native stack.
+template <typename Replace>
+static TermPtr rebuildTerm(TermArena& arena, TermPtr root, const Replace& replace) {
+    std::vector<std::pair<TermPtr, bool>> frames{{root, false}};
+    std::vector<TermPtr> results;
+    
+    while (!frames.empty()) {
+        auto [term, childrenDone] = frames.back();
+        frames.pop_back();
+        
+        if (childrenDone) {
+            if (term->kind == TermKind::Abstraction) {
+                results.back() = arena.makeAbstraction(term->name, results.back());
+            } else {
+                TermPtr argument = results.back();
+                results.pop_back();
+                results.back() = arena.makeApplication(results.back(), argument);
+            }
+            continue;
+        }
+        
+        TermPtr replacement = replace(term);
+        if (replacement || (term->kind != TermKind::Abstraction && term->kind != TermKind::Application)) {
+            results.push_back(replacement ? replacement : term);
+            continue;
+        }
+        // The function is popped and rebuilt first
+        frames.push_back({term, true});
+        if (term->right) {
+            frames.push_back({term->right, false});
+        }
+        frames.push_back({term->left, false});
+    }
+    
+    return results.back();
+}
+
+// Whether two terms are equal up to the names of their parameters. Hints
+// are the only part of a node that does not affect its meaning, so equal
+// leaves are the same node.
+static bool alphaEquivalent(TermPtr a, TermPtr b) {
+    std::vector<std::pair<TermPtr, TermPtr>> pending{{a, b}};
+    
+    while (!pending.empty()) {
+        auto [left, right] = pending.back();
+        pending.pop_back();
+        if (left == right) {
+            continue;
+        }
+        if (left->kind != right->kind || left->size != right->size) {
+            return false;
+        }
+        
+        switch (left->kind) {
+            case TermKind::Abstraction:
+                pending.push_back({left->left, right->left});
+                break;
+            case TermKind::Application:
+                pending.push_back({left->right, right->right});
+                pending.push_back({left->left, right->left});
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+static TermPtr makeChurchBoolean(TermArena& arena, bool value) {
+    return arena.makeAbstraction(internSymbol("t"), arena.makeAbstraction(internSymbol("f"), arena.makeBound(value ? 1 : 0)));
+}
+
+std::size_t getArity(Primitive primitive) {
+    switch (primitive) {
+        case Primitive::Successor:
+        case Primitive::Predecessor:
+        case Primitive::IsZero:
+            return 1;
+        default:
+            return 2;
+    }
+}
+
+TermPtr applyPrimitive(TermArena& arena, Primitive primitive, const std::vector<std::size_t>& arguments) {
+    std::size_t m = arguments[0];
+    std::size_t n = arguments.size() > 1 ? arguments[1] : 0;
+    
+    switch (primitive) {
+        case Primitive::Successor:
+            return m == SIZE_MAX ? nullptr : arena.makeInteger(m + 1);
+        case Primitive::Predecessor:
+            return arena.makeInteger(m > 0 ? m - 1 : 0);
+        case Primitive::Add:
+            return n > SIZE_MAX - m ? nullptr : arena.makeInteger(m + n);
+        case Primitive::Subtract:
+            return arena.makeInteger(m > n ? m - n : 0);
+        case Primitive::Multiply:
+            return m != 0 && n > SIZE_MAX / m ? nullptr : arena.makeInteger(m * n);
+        case Primitive::IsZero:
+            return makeChurchBoolean(arena, m == 0);
+        case Primitive::LessOrEqual:
+            return makeChurchBoolean(arena, m <= n);
+    }
+    return nullptr;
+}
+
+TermPtr makeChurchNumeral(TermArena& arena, std::size_t value, const NodeCheck& check) {
+    if (check) {
+        check(value > SIZE_MAX - 4 ? SIZE_MAX : value + 4);
+    }
+    TermPtr body = arena.makeBound(0);
+    for (std::size_t i = 0; i < value; ++i) {
+        body = arena.makeApplication(arena.makeBound(1), body);
+        if (check && i % 4096 == 4095) {
+            check(0);
+        }
+    }
+    return arena.makeAbstraction(internSymbol("f"), arena.makeAbstraction(internSymbol("x"), body));
+}
+
+bool matchChurchNumeral(TermPtr term, std::size_t& value) {
+    if (term->kind != TermKind::Abstraction || term->left->kind != TermKind::Abstraction) {
+        return false;
+    }
+    
+    std::size_t count = 0;
+    TermPtr body = term->left->left;
+    for (; body->kind == TermKind::Application; body = body->right) {
+        if (body->left->kind != TermKind::Bound || body->left->index != 1) {
+            return false;
+        }
+        ++count;
+    }
+    if (body->kind != TermKind::Bound || body->index != 0) {
+        return false;
+    }
+    
+    value = count;
+    return true;
+}
+
+TermPtr unfoldNative(TermArena& arena, TermPtr term, const NodeCheck& check) {
+    if (term->left) {
+        return term->left;
+    }
+    return makeChurchNumeral(arena, term->index, check);
+}
+
+TermPtr expandNatives(TermArena& arena, TermPtr term, const NodeCheck& check) {
+    if (!term->native) {
+        return term;
+    }
+    return rebuildTerm(arena, term, [&arena, &check](TermPtr subterm) -> TermPtr {
+        if (!subterm->native) {
+            return subterm;
+        }
+        if (subterm->kind == TermKind::Integer || subterm->kind == TermKind::Primitive) {
+            return unfoldNative(arena, subterm, check);
+        }
+        return nullptr;
+    });
+}
+
+TermPtr NativeRecognizer::recognize(TermPtr term) {
+    if (encodings.empty()) {
+        for (const auto& expression : getEncodingExpressions()) {
+            encodings.push_back(toDeBruijn(arena, *expression));
+        }
+    }
+    
+    return rebuildTerm(arena, term, [this](TermPtr subterm) -> TermPtr {
+        // Numerals and encodings all start with two abstractions
+        if (subterm->kind != TermKind::Abstraction || subterm->left->kind != TermKind::Abstraction) {
+            return nullptr;
+        }
+        std::size_t value;
+        if (matchChurchNumeral(subterm, value)) {
+            return arena.makeInteger(value, subterm);
+        }
+        for (std::size_t i = 0; i < encodings.size(); ++i) {
+            if (alphaEquivalent(subterm, encodings[i])) {
+                return arena.makePrimitive(i, subterm);
+            }
+        }
+        return nullptr;
+    });
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "debruijn.h"
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Arithmetic operations of the native extension. Each stands for the Church
+// encoding of the prelude definition named after it and is applied by a
+// delta rule once its arguments are native integers.
+enum class Primitive {
+    Successor,      // succ
+    Predecessor,    // pred
+    Add,            // plus
+    Subtract,       // sub, truncated at zero
+    Multiply,       // mult
+    IsZero,         // iszero
+    LessOrEqual     // leq
+};
+
+// Number of arguments a primitive takes
+std::size_t getArity(Primitive primitive);
+
+// Apply a primitive to native integers. The result is an integer, or a
+// Church boolean for comparisons; null if the result does not fit.
+TermPtr applyPrimitive(TermArena& arena, Primitive primitive, const std::vector<std::size_t>& arguments);
+
+// Called with the number of nodes a Church numeral will add before it is
+// built, and with zero every few thousand nodes while it is built, so an
+// evaluation can throw LimitExceededError before a large numeral exhausts
+// its node or time limit
+using NodeCheck = std::function<void(std::size_t nodes)>;
+
+// Church numeral λf.λx.f (... (f x)) applying f value times
+TermPtr makeChurchNumeral(TermArena& arena, std::size_t value, const NodeCheck& check = nullptr);
+
+// Read the value of a term shaped like a Church numeral; returns false for any other term
+bool matchChurchNumeral(TermPtr term, std::size_t& value);
+
+// Church form of an Integer or Primitive node
+TermPtr unfoldNative(TermArena& arena, TermPtr term, const NodeCheck& check = nullptr);
+
+// Replace every native node in a term by its Church form, so the term can
+// be given to engines without native support or printed as the pure mode would
+TermPtr expandNatives(TermArena& arena, TermPtr term, const NodeCheck& check = nullptr);
+
+// Replaces Church numerals and the Church encodings of the primitives in the
+// terms of one evaluation by native nodes. Encodings are matched up to the
+// names of their parameters, and each native node keeps the term it
+// replaces, so unfolding it gives back exactly what was written.
+class NativeRecognizer {
+private:
+    TermArena& arena;
+    
+    // Encoding of each primitive in the arena, built on first use
+    std::vector<TermPtr> encodings;
+
+public:
+    explicit NativeRecognizer(TermArena& arena) : arena(arena) {}
+    
+    // Replace the numerals and encodings in a term
+    TermPtr recognize(TermPtr term);
+    
+    // Forget the encodings, before the arena is reset
+    void clear() { encodings.clear(); }
+};
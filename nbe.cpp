@@ -0,0 +1,171 @@
+#include "nbe.h"
+#include <vector>
+
+// Deepest nesting of eval calls before giving up instead of overflowing the stack
+static constexpr std::size_t maxNesting = 20000;
+
+enum class ValueKind {
+    Closure,    // Lambda with its scope
+    Neutral     // Variable or free name applied to arguments
+};
+
+struct NbeEvaluator::Value {
+    ValueKind kind;
+    TermPtr term;               // Closure: the lambda; Neutral: the free name, or null for a variable
+    const Scope* scope;         // Closure
+    std::size_t level;          // Neutral variable: bound by the level-th lambda entered while quoting
+    Thunk* argument;            // Neutral: last argument, or null
+    const Value* function;      // Neutral: the value the last argument is applied to
+};
+
+// Argument whose value is computed on first use and then shared
+struct NbeEvaluator::Thunk {
+    TermPtr term;
+    const Scope* scope;
+    const Value* value;
+};
+
+// Scopes are immutable linked lists, innermost binding first
+struct NbeEvaluator::Scope {
+    Thunk* thunk;
+    const Scope* next;
+};
+
+NbeEvaluator::Thunk* NbeEvaluator::delay(TermPtr term, const Scope* scope) {
+    if (term->kind == TermKind::Bound) {
+        // A variable argument shares the thunk it is bound to
+        for (std::size_t i = 0; i < term->index; ++i) {
+            scope = scope->next;
+        }
+        return scope->thunk;
+    }
+    return values.create<Thunk>(Thunk{term, scope, nullptr});
+}
+
+const NbeEvaluator::Value* NbeEvaluator::force(Thunk* thunk) {
+    if (!thunk->value) {
+        thunk->value = eval(thunk->term, thunk->scope);
+    }
+    return thunk->value;
+}
+
+const NbeEvaluator::Value* NbeEvaluator::apply(const Value* function, Thunk* argument) {
+    // Neutral applications take no step, so the values are charged here
+    machineNodes.update(values.getAllocationCount());
+    if (function->kind == ValueKind::Closure) {
+        // Beta reduction is application in the semantic domain
+        context.countStep(StepKind::Beta, 0, function->term);
+        return eval(function->term->left, values.create<Scope>(Scope{argument, function->scope}));
+    }
+    return values.create<Value>(Value{ValueKind::Neutral, nullptr, nullptr, 0, argument, function});
+}
+
+const NbeEvaluator::Value* NbeEvaluator::eval(TermPtr term, const Scope* scope) {
+    if (++nesting > maxNesting) {
+        throw EvaluationError("Term nests too deeply for normalization by evaluation");
+    }
+    
+    const Value* result = nullptr;
+    switch (term->kind) {
+        case TermKind::Bound:
+            result = force(delay(term, scope));
+            break;
+        case TermKind::Abstraction:
+            result = values.create<Value>(Value{ValueKind::Closure, term, scope, 0, nullptr, nullptr});
+            break;
+        case TermKind::Application: {
+            const Value* function = eval(term->left, scope);
+            result = apply(function, delay(term->right, scope));
+            break;
+        }
+        case TermKind::Reference: {
+            auto definition = context.lookupDefinition(term->name);
+            if (definition) {
+                context.countStep(StepKind::Delta, term->name, definition);
+                result = eval(definition, nullptr);
+                break;
+            }
+            result = values.create<Value>(Value{ValueKind::Neutral, term, nullptr, 0, nullptr, nullptr});
+            break;
+        }
+        default:
+            result = values.create<Value>(Value{ValueKind::Neutral, term, nullptr, 0, nullptr, nullptr});
+            break;
+    }
+    
+    --nesting;
+    return result;
+}
+
+// Read a value back as a term. Uses an explicit stack, so only evaluation
+// nests natively, not the size of the normal form.
+TermPtr NbeEvaluator::quote(const Value* start) {
+    TermArena& terms = context.getArena();
+    
+    enum class FrameKind {
+        QuoteBody,          // Wrap the quoted body in a lambda
+        QuoteArgument,      // Quote the next argument of a neutral value
+        BuildApplication    // Apply the quoted function to the quoted argument
+    };
+    struct Frame {
+        FrameKind kind;
+        TermPtr term;       // QuoteBody: the lambda; BuildApplication: the function
+        Thunk* argument;    // QuoteArgument
+    };
+    
+    std::vector<Frame> stack;
+    std::size_t depth = 0;
+    const Value* value = start;
+    
+    while (true) {
+        TermPtr quoted = nullptr;
+        machineNodes.update(values.getAllocationCount() + stack.size());
+        
+        if (value->kind == ValueKind::Closure) {
+            // Evaluate the body with a fresh variable for the parameter
+            auto variable = values.create<Value>(Value{ValueKind::Neutral, nullptr, nullptr, depth++, nullptr, nullptr});
+            auto argument = values.create<Thunk>(Thunk{nullptr, nullptr, variable});
+            stack.push_back({FrameKind::QuoteBody, value->term, nullptr});
+            value = eval(value->term->left, values.create<Scope>(Scope{argument, value->scope}));
+            continue;
+        }
+        
+        // Queue the arguments, first argument on top, then quote the head
+        for (; value->argument; value = value->function) {
+            stack.push_back({FrameKind::QuoteArgument, nullptr, value->argument});
+        }
+        quoted = value->term ? value->term : terms.makeBound(depth - 1 - value->level);
+        
+        // Pass the quoted term outwards until another value has to be quoted
+        value = nullptr;
+        while (!value) {
+            if (stack.empty()) {
+                return quoted;
+            }
+            
+            Frame frame = stack.back();
+            stack.pop_back();
+            
+            switch (frame.kind) {
+                case FrameKind::QuoteBody:
+                    quoted = terms.makeAbstraction(frame.term->name, quoted);
+                    --depth;
+                    break;
+                case FrameKind::QuoteArgument:
+                    stack.push_back({FrameKind::BuildApplication, quoted, nullptr});
+                    value = force(frame.argument);
+                    break;
+                case FrameKind::BuildApplication:
+                    quoted = terms.makeApplication(frame.term, quoted);
+                    break;
+            }
+        }
+    }
+}
+
+TermPtr NbeEvaluator::normalize(TermPtr term) {
+    nesting = 0;
+    TermPtr result = quote(eval(term, nullptr));
+    context.countMachineNodes(values.getAllocationCount());
+    return result;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "debruijn.h"
+#include "reduction.h"
+#include "arena.h"
+
+// Normalization by evaluation.
+// Terms are evaluated into a semantic domain of closures and neutral terms
+// (a variable or free name applied to arguments), where beta reduction is
+// just function application in the host. The value is then quoted back
+// into a normal form term in one pass, with no search for redexes and no
+// substitution. Arguments are evaluated lazily and at most once, so the
+// result agrees with normal order wherever normal order terminates.
+class NbeEvaluator {
+private:
+    struct Value;
+    struct Thunk;
+    struct Scope;
+    
+    IReductionContext& context;
+    
+    // Values, thunks and scopes are only needed until the result is quoted
+    Arena values;
+    MachineNodeCounter machineNodes;
+    
+    // Nesting of eval calls, which use native stack
+    std::size_t nesting = 0;
+    
+    const Value* eval(TermPtr term, const Scope* scope);
+    const Value* apply(const Value* function, Thunk* argument);
+    const Value* force(Thunk* thunk);
+    Thunk* delay(TermPtr term, const Scope* scope);
+    TermPtr quote(const Value* value);
+
+public:
+    explicit NbeEvaluator(IReductionContext& context) : context(context), machineNodes(context) {}
+    
+    // Reduce a closed-over term to normal form
+    TermPtr normalize(TermPtr term);
+};
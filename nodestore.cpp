@@ -0,0 +1,130 @@
+#include "nodestore.h"
+#include "visitor.h"
+#include <limits>
+#include <stdexcept>
+
+NodeHandle NodeStore::add(NodeTag tag, Symbol name, NodeHandle left, NodeHandle right) {
+    if (tags.size() >= std::numeric_limits<NodeHandle>::max()) {
+        throw std::length_error("Node store is full");
+    }
+    tags.push_back(tag);
+    names.push_back(name);
+    lefts.push_back(left);
+    rights.push_back(right);
+    return static_cast<NodeHandle>(tags.size() - 1);
+}
+
+NodeHandle NodeStore::makeInteger(std::size_t value) {
+    auto wide = static_cast<std::uint64_t>(value);
+    return add(NodeTag::Integer, 0, static_cast<NodeHandle>(wide), static_cast<NodeHandle>(wide >> 32));
+}
+
+std::size_t NodeStore::getValue(NodeHandle node) const {
+    return static_cast<std::size_t>(static_cast<std::uint64_t>(rights[node]) << 32 | lefts[node]);
+}
+
+void NodeStore::clear() {
+    tags.clear();
+    names.clear();
+    lefts.clear();
+    rights.clear();
+}
+
+// Adds the nodes of an expression to a store, children first
+class NodeImporter : public ITraversal {
+private:
+    NodeStore& store;
+    std::vector<NodeHandle> results;
+    
+    NodeHandle pop() {
+        NodeHandle node = results.back();
+        results.pop_back();
+        return node;
+    }
+
+public:
+    explicit NodeImporter(NodeStore& store) : store(store) {}
+    
+    void visit(const Variable& variable) override {
+        results.push_back(store.makeVariable(variable.getSymbol()));
+    }
+    
+    void visit(const NamedReference& reference) override {
+        results.push_back(store.makeReference(reference.getSymbol()));
+    }
+    
+    void visit(const IntegerLiteral& literal) override {
+        results.push_back(store.makeInteger(literal.getValue()));
+    }
+    
+    void leave(const Abstraction& abstraction) override {
+        results.push_back(store.makeAbstraction(abstraction.getParameterSymbol(), pop()));
+    }
+    
+    void leave(const Application&) override {
+        NodeHandle argument = pop();
+        NodeHandle function = pop();
+        results.push_back(store.makeApplication(function, argument));
+    }
+    
+    NodeHandle getResult() {
+        return pop();
+    }
+};
+
+NodeHandle NodeStore::fromExpression(const Expression& expr) {
+    NodeImporter importer(*this);
+    traverse(expr, importer);
+    return importer.getResult();
+}
+
+// Build the expression of a node after those of its children. Uses an
+// explicit stack so deep expressions do not exhaust the native stack.
+std::shared_ptr<Expression> NodeStore::toExpression(NodeHandle root) const {
+    ExpressionBuilder builder;
+    std::vector<std::pair<NodeHandle, bool>> stack{{root, false}};
+    std::vector<std::shared_ptr<Expression>> results;
+    
+    while (!stack.empty()) {
+        auto [node, childrenDone] = stack.back();
+        stack.pop_back();
+        
+        switch (tags[node]) {
+            case NodeTag::Variable:
+                results.push_back(builder.makeVariable(names[node]));
+                break;
+            case NodeTag::Reference:
+                results.push_back(builder.makeReference(names[node]));
+                break;
+            case NodeTag::Integer:
+                results.push_back(builder.makeInteger(getValue(node)));
+                break;
+            case NodeTag::Abstraction: {
+                if (!childrenDone) {
+                    stack.push_back({node, true});
+                    stack.push_back({lefts[node], false});
+                    break;
+                }
+                auto body = std::move(results.back());
+                results.pop_back();
+                results.push_back(builder.makeAbstraction(names[node], std::move(body)));
+                break;
+            }
+            case NodeTag::Application: {
+                if (!childrenDone) {
+                    stack.push_back({node, true});
+                    stack.push_back({rights[node], false});
+                    stack.push_back({lefts[node], false});
+                    break;
+                }
+                auto argument = std::move(results.back());
+                results.pop_back();
+                auto function = std::move(results.back());
+                results.pop_back();
+                results.push_back(builder.makeApplication(std::move(function), std::move(argument)));
+                break;
+            }
+        }
+    }
+    return results.back();
+}
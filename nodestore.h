@@ -0,0 +1,78 @@
+#pragma once
+
+#include "expression.h"
+#include "symbol.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Kinds of nodes in a NodeStore
+enum class NodeTag : std::uint8_t {
+    Variable,
+    Reference,
+    Integer,
+    Abstraction,
+    Application
+};
+
+// Index of a node in a NodeStore
+using NodeHandle = std::uint32_t;
+
+// Named expressions stored as one contiguous array of nodes, as an
+// alternative to the heap allocated Expression classes. Each field is a
+// separate vector (struct of arrays) indexed by 32-bit handles, so a walk
+// over the store touches a few dense arrays, and nodes are dispatched on a
+// one byte tag instead of a virtual call. Nodes are immutable and children
+// are always added before their parents; the store grows until cleared.
+class NodeStore {
+private:
+    std::vector<NodeTag> tags;
+    std::vector<Symbol> names;          // Variable/Reference: the name; Abstraction: the parameter
+    std::vector<NodeHandle> lefts;      // Abstraction: body; Application: function; Integer: low 32 bits
+    std::vector<NodeHandle> rights;     // Application: argument; Integer: high 32 bits
+    
+    NodeHandle add(NodeTag tag, Symbol name, NodeHandle left, NodeHandle right);
+
+public:
+    using Handle = NodeHandle;
+    
+    // Node constructors, with the same interface as ExpressionBuilder
+    NodeHandle makeVariable(Symbol name) { return add(NodeTag::Variable, name, 0, 0); }
+    NodeHandle makeReference(Symbol name) { return add(NodeTag::Reference, name, 0, 0); }
+    NodeHandle makeInteger(std::size_t value);
+    NodeHandle makeAbstraction(Symbol parameter, NodeHandle body) { return add(NodeTag::Abstraction, parameter, body, 0); }
+    NodeHandle makeApplication(NodeHandle function, NodeHandle argument) { return add(NodeTag::Application, 0, function, argument); }
+    
+    NodeTag getTag(NodeHandle node) const { return tags[node]; }
+    Symbol getName(NodeHandle node) const { return names[node]; }
+    NodeHandle getBody(NodeHandle node) const { return lefts[node]; }
+    NodeHandle getFunction(NodeHandle node) const { return lefts[node]; }
+    NodeHandle getArgument(NodeHandle node) const { return rights[node]; }
+    std::size_t getValue(NodeHandle node) const;
+    
+    // Number of nodes
+    std::size_t size() const { return tags.size(); }
+    
+    // Remove every node, keeping the memory for reuse
+    void clear();
+    
+    // Adapters from and to the Expression classes
+    NodeHandle fromExpression(const Expression& expr);
+    std::shared_ptr<Expression> toExpression(NodeHandle node) const;
+};
+
+// Builds Expression nodes through the interface of NodeStore, so code that
+// constructs expressions can target either representation
+class ExpressionBuilder {
+public:
+    using Handle = std::shared_ptr<Expression>;
+    
+    Handle makeVariable(Symbol name) { return std::make_shared<Variable>(name); }
+    Handle makeReference(Symbol name) { return std::make_shared<NamedReference>(name); }
+    Handle makeInteger(std::size_t value) { return std::make_shared<IntegerLiteral>(value); }
+    Handle makeAbstraction(Symbol parameter, Handle body) { return std::make_shared<Abstraction>(parameter, std::move(body)); }
+    Handle makeApplication(Handle function, Handle argument) {
+        return std::make_shared<Application>(std::move(function), std::move(argument));
+    }
+};
@@ -0,0 +1,247 @@
+#include "normalorder.h"
+#include "native.h"
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// Deepest nesting of primitive arguments normalized ahead of the primitive;
+// deeper primitives are unfolded into their Church encodings instead
+constexpr std::size_t maxStrictDepth = 256;
+
+// Steps a primitive may spend normalizing its arguments before it gives up
+// and is unfolded into its Church encoding, so an argument without a normal
+// form does not stop an evaluation that the pure mode completes
+constexpr std::size_t argumentStepBudget = 10000;
+
+enum class FrameKind {
+    Argument,       // Argument waiting on the spine of the current head
+    Function,       // Normalized function waiting for its normalized argument
+    Abstraction     // Abstraction waiting for its normalized body
+};
+
+struct Frame {
+    FrameKind kind;
+    TermPtr term;
+};
+
+TermPtr normalizeTerm(IReductionContext& context, TermPtr term, std::size_t depth);
+
+// Thrown by a budget context when its steps run out
+class BudgetExceededError : public std::runtime_error {
+public:
+    const IReductionContext* budget;
+    
+    explicit BudgetExceededError(const IReductionContext* budget)
+        : std::runtime_error("Argument step budget exceeded"), budget(budget) {}
+};
+
+// Context for normalizing the arguments of a primitive: passes every step
+// on to the evaluation, then throws once its own budget is spent
+class BudgetContext : public IReductionContext {
+private:
+    IReductionContext& context;
+    std::size_t remaining;
+
+public:
+    BudgetContext(IReductionContext& context, std::size_t budget) : context(context), remaining(budget) {}
+    
+    TermArena& getArena() override { return context.getArena(); }
+    TermPtr lookupDefinition(Symbol name) override { return context.lookupDefinition(name); }
+    
+    void countStep(StepKind kind, Symbol definition, TermPtr term) override {
+        context.countStep(kind, definition, term);
+        if (remaining-- == 0) {
+            throw BudgetExceededError(this);
+        }
+    }
+    
+    void countMachineNodes(std::size_t nodes) override { context.countMachineNodes(nodes); }
+};
+
+// Delta rule for a primitive: normalize the arguments on the spine within
+// a step budget and, if they are all native integers, replace the
+// application by its result. Church numerals are accepted as integers.
+// Returns false if there are too few arguments, the budget runs out or one
+// of them is not an integer; the arguments normalized so far are left on
+// the stack in their normal forms.
+bool applyDelta(IReductionContext& context, TermPtr& term, std::vector<Frame>& stack, std::size_t depth) {
+    TermArena& arena = context.getArena();
+    auto primitive = static_cast<Primitive>(term->index);
+    std::size_t arity = getArity(primitive);
+    if (stack.size() < arity || depth >= maxStrictDepth) {
+        return false;
+    }
+    
+    // The first argument is on top of the stack
+    BudgetContext budget(context, argumentStepBudget);
+    std::vector<std::size_t> values;
+    for (std::size_t i = 0; i < arity; ++i) {
+        Frame& frame = stack[stack.size() - 1 - i];
+        if (frame.kind != FrameKind::Argument) {
+            return false;
+        }
+        if (frame.term->kind != TermKind::Integer) {
+            try {
+                frame.term = normalizeTerm(budget, frame.term, depth + 1);
+            } catch (const BudgetExceededError& error) {
+                if (error.budget != &budget) {
+                    throw;
+                }
+                return false;
+            }
+        }
+        
+        std::size_t value;
+        if (frame.term->kind == TermKind::Integer) {
+            value = frame.term->index;
+        } else if (!matchChurchNumeral(frame.term, value)) {
+            return false;
+        }
+        values.push_back(value);
+    }
+    
+    TermPtr result = applyPrimitive(arena, primitive, values);
+    if (!result) {
+        return false;
+    }
+    context.countStep(StepKind::Native, 0, term);
+    stack.resize(stack.size() - arity);
+    term = result;
+    return true;
+}
+
+// Unwind the spine, contracting head redexes and entering lambdas that have
+// no argument, until the head is stuck. Leaves the stuck head in term.
+// If weak, stops at a lambda with no argument instead of entering it.
+// Native terms are unfolded into their Church forms wherever a primitive
+// cannot be applied or an integer is applied like a function.
+void unwind(IReductionContext& context, TermPtr& term, std::vector<Frame>& stack, std::size_t depth, bool weak = false) {
+    TermArena& arena = context.getArena();
+    
+    while (true) {
+        if (term->kind == TermKind::Application) {
+            stack.push_back({FrameKind::Argument, term->right});
+            term = term->left;
+        } else if (term->kind == TermKind::Abstraction) {
+            if (stack.empty() || stack.back().kind != FrameKind::Argument) {
+                // Weak head normal form: continue under the lambda
+                if (weak) {
+                    return;
+                }
+                stack.push_back({FrameKind::Abstraction, term});
+                term = term->left;
+                continue;
+            }
+            context.countStep(StepKind::Beta, 0, term);
+            term = instantiate(arena, term->left, stack.back().term);
+            stack.pop_back();
+        } else if (term->kind == TermKind::Reference) {
+            auto definition = context.lookupDefinition(term->name);
+            if (!definition) {
+                return;
+            }
+            context.countStep(StepKind::Delta, term->name, definition);
+            term = definition;
+        } else if (term->kind == TermKind::Primitive) {
+            if (!applyDelta(context, term, stack, depth)) {
+                context.countStep(StepKind::Native, 0, term);
+                term = unfoldNative(arena, term);
+            }
+        } else if (term->kind == TermKind::Integer && !stack.empty() && stack.back().kind == FrameKind::Argument) {
+            context.countStep(StepKind::Native, 0, term);
+            term = unfoldNative(arena, term);
+        } else {
+            return;
+        }
+    }
+}
+
+// Plug a term back into the context described by the stack
+TermPtr rebuild(TermArena& arena, TermPtr term, std::vector<Frame>& stack) {
+    while (!stack.empty()) {
+        Frame frame = stack.back();
+        stack.pop_back();
+        
+        switch (frame.kind) {
+            case FrameKind::Argument:
+                term = arena.makeApplication(term, frame.term);
+                break;
+            case FrameKind::Function:
+                term = arena.makeApplication(frame.term, term);
+                break;
+            case FrameKind::Abstraction:
+                term = arena.makeAbstraction(frame.term->name, term);
+                break;
+        }
+    }
+    return term;
+}
+
+// Reduce a term to normal form; depth counts the primitives whose
+// arguments are being normalized around this call
+TermPtr normalizeTerm(IReductionContext& context, TermPtr term, std::size_t depth) {
+    TermArena& arena = context.getArena();
+    std::vector<Frame> stack;
+    
+    while (true) {
+        try {
+            unwind(context, term, stack, depth);
+        } catch (LimitExceededError& error) {
+            // Everything reduced so far, with the rest left as it is
+            error.setPartialResult(rebuild(arena, term, stack));
+            throw;
+        }
+        
+        // The head is stuck: rebuild outwards, normalizing the pending arguments
+        bool resumed = false;
+        while (!stack.empty() && !resumed) {
+            Frame frame = stack.back();
+            stack.pop_back();
+            
+            switch (frame.kind) {
+                case FrameKind::Argument:
+                    stack.push_back({FrameKind::Function, term});
+                    term = frame.term;
+                    resumed = true;
+                    break;
+                case FrameKind::Function:
+                    term = arena.makeApplication(frame.term, term);
+                    break;
+                case FrameKind::Abstraction:
+                    term = arena.makeAbstraction(frame.term->name, term);
+                    break;
+            }
+        }
+        
+        if (!resumed) {
+            return term;
+        }
+    }
+}
+
+}
+
+TermPtr NormalOrderReducer::normalize(TermPtr term) {
+    return normalizeTerm(context, term, 0);
+}
+
+TermPtr NormalOrderReducer::reduceToHeadNormalForm(TermPtr term) {
+    TermArena& arena = context.getArena();
+    std::vector<Frame> stack;
+    
+    unwind(context, term, stack, 0);
+    
+    // Only lambdas and unreduced arguments are left on the stack
+    return rebuild(arena, term, stack);
+}
+
+TermPtr NormalOrderReducer::reduceToWeakHeadNormalForm(TermPtr term) {
+    TermArena& arena = context.getArena();
+    std::vector<Frame> stack;
+    
+    unwind(context, term, stack, 0, true);
+    
+    // Only unreduced arguments are left on the stack
+    return rebuild(arena, term, stack);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "debruijn.h"
+#include "reduction.h"
+
+// Normal order reduction by substitution on nameless terms.
+// The leftmost outermost redex is always contracted first. The continuation
+// is kept in an explicit stack of frames, so neither the number of steps
+// nor the depth of the term uses native stack.
+class NormalOrderReducer {
+private:
+    IReductionContext& context;
+
+public:
+    explicit NormalOrderReducer(IReductionContext& context) : context(context) {}
+    
+    // Reduce a term to normal form. When a limit is exceeded, the term
+    // reduced so far is attached to the LimitExceededError.
+    TermPtr normalize(TermPtr term);
+    
+    // Reduce a term to head normal form λx1...λxn.h a1...ak, where the head h
+    // is a variable and the arguments are left unreduced
+    TermPtr reduceToHeadNormalForm(TermPtr term);
+    
+    // Reduce a term to weak head normal form: an abstraction, with its body
+    // left unreduced, or a stuck head h a1...ak with unreduced arguments
+    TermPtr reduceToWeakHeadNormalForm(TermPtr term);
+};
@@ -0,0 +1,306 @@
+#include "parallel.h"
+#include "normalorder.h"
+#include <algorithm>
+#include <exception>
+
+// Deepest nesting of forked tasks on one thread; deeper forks run sequentially
+static constexpr std::size_t maxForkDepth = 64;
+
+// Counters are published to the shared totals in batches of steps to avoid contention
+static constexpr std::size_t stepBatch = 1024;
+
+// Reduction state owned by one thread. Workers only read memoized normal
+// forms of definitions; the evaluator computes them before forking.
+struct ParallelReducer::Worker : public IReductionContext {
+    ParallelReducer& owner;
+    TermArena arena;
+    DefinitionCache definitions;
+    NormalOrderReducer reducer;
+    std::size_t steps = 0;
+    std::size_t deltaSteps = 0;
+    std::size_t publishedNodes = 0;
+    
+    explicit Worker(ParallelReducer& owner)
+        : owner(owner), definitions(owner.environment, arena), reducer(*this) {}
+    
+    TermArena& getArena() override { return arena; }
+    
+    TermPtr lookupDefinition(Symbol name) override {
+        return definitions.lookup(name);
+    }
+    
+    void countStep(StepKind kind, Symbol, TermPtr) override {
+        if (kind != StepKind::Beta) {
+            ++deltaSteps;
+        }
+        if (++steps % stepBatch == 0) {
+            owner.publish(*this);
+        }
+    }
+    
+    // Workers reduce in normal order, which holds no machine objects
+    void countMachineNodes(std::size_t) override {}
+};
+
+// Normalization of one argument running as a pool task
+struct ParallelReducer::Subtask {
+    TermPtr result = nullptr;
+    std::exception_ptr error;
+    bool cancelled = false;             // The error is a CancelledError
+    std::atomic<bool> done{false};
+};
+
+namespace {
+
+// Thrown in the tasks of an evaluation once another task failed. The
+// reducer looks for the error that caused it instead of reporting it.
+class CancelledError : public EvaluationError {
+public:
+    CancelledError() : EvaluationError("Evaluation cancelled") {}
+};
+
+}
+
+ParallelReducer::ParallelReducer(Environment& environment, std::size_t threadCount, std::size_t threshold)
+    : environment(environment), pool(threadCount), threshold(threshold) {
+    for (std::size_t i = 0; i <= pool.getThreadCount(); ++i) {
+        workers.push_back(std::make_unique<Worker>(*this));
+    }
+}
+
+ParallelReducer::~ParallelReducer() = default;
+
+ParallelReducer::Worker& ParallelReducer::currentWorker() {
+    return *workers[pool.getWorkerIndex()];
+}
+
+// Add a batch of steps and the worker's new nodes to the totals and check the limits
+void ParallelReducer::publish(Worker& worker) {
+    if (cancelled) {
+        throw CancelledError();
+    }
+    std::size_t nodes = worker.arena.getNodeCount() - worker.publishedNodes;
+    worker.publishedNodes += nodes;
+    try {
+        monitor.check(sharedSteps += stepBatch, sharedNodes += nodes, true);
+    } catch (...) {
+        fail();
+        throw;
+    }
+}
+
+// Cancel the other tasks for the error being handled, keeping the first
+// such error in case the task that raised it cannot be found
+void ParallelReducer::fail() {
+    if (!cancelled.exchange(true)) {
+        failure = std::current_exception();
+    }
+}
+
+void ParallelReducer::collectStats(EvaluationStats& stats) const {
+    for (const auto& worker : workers) {
+        stats.betaSteps += worker->steps - worker->deltaSteps;
+        stats.deltaSteps += worker->deltaSteps;
+        stats.nodesAllocated += worker->arena.getNodeCount();
+        stats.peakTermSize = std::max(stats.peakTermSize, worker->arena.getPeakSize());
+    }
+}
+
+std::shared_ptr<ParallelReducer::Subtask> ParallelReducer::spawn(TermPtr term, std::size_t forkDepth) {
+    auto subtask = std::make_shared<Subtask>();
+    ++outstandingTasks;
+    pool.submit([this, subtask, term, forkDepth] {
+        try {
+            subtask->result = normalizeTask(term, forkDepth);
+        } catch (const CancelledError&) {
+            subtask->error = std::current_exception();
+            subtask->cancelled = true;
+        } catch (...) {
+            subtask->error = std::current_exception();
+            fail();
+        }
+        subtask->done = true;
+        --outstandingTasks;
+    });
+    return subtask;
+}
+
+TermPtr ParallelReducer::normalizeTask(TermPtr term, std::size_t forkDepth) {
+    // Head normal form whose arguments are being normalized. One large
+    // argument continues on this thread; the others run as subtasks.
+    struct Pending {
+        std::vector<TermPtr> lambdas;
+        TermPtr head;
+        std::vector<TermPtr> arguments;
+        std::vector<std::pair<std::size_t, std::shared_ptr<Subtask>>> subtasks;
+        std::size_t hole;
+    };
+    
+    Worker& worker = currentWorker();
+    std::vector<Pending> pending;
+    TermPtr result = nullptr;
+    
+    // Apply the head of a node to its arguments, under its lambdas
+    auto build = [&worker](const Pending& node) {
+        TermPtr term = node.head;
+        for (TermPtr argument : node.arguments) {
+            term = worker.arena.makeApplication(term, argument);
+        }
+        for (auto it = node.lambdas.rbegin(); it != node.lambdas.rend(); ++it) {
+            term = worker.arena.makeAbstraction((*it)->name, term);
+        }
+        return term;
+    };
+    
+    // When a limit stops the argument in the hole of the innermost pending
+    // node, put the term reduced so far back into the enclosing spines, so
+    // the partial result covers the whole term as under normal order
+    auto rethrowWithSpine = [&](LimitExceededError& error) {
+        TermPtr partial = error.getPartialResult();
+        while (!pending.empty()) {
+            Pending& node = pending.back();
+            if (partial) {
+                node.arguments[node.hole] = partial;
+            }
+            partial = build(node);
+            pending.pop_back();
+        }
+        if (partial) {
+            error.setPartialResult(partial);
+        }
+        throw;
+    };
+    
+    try {
+        while (!result) {
+            TermPtr form = worker.reducer.reduceToHeadNormalForm(term);
+            
+            Pending node;
+            for (; form->kind == TermKind::Abstraction; form = form->left) {
+                node.lambdas.push_back(form);
+            }
+            for (; form->kind == TermKind::Application; form = form->left) {
+                node.arguments.push_back(form->right);
+            }
+            node.head = form;
+            std::reverse(node.arguments.begin(), node.arguments.end());
+            
+            // Continue with the last large argument, fork the other large ones
+            std::size_t large = node.arguments.size();
+            for (std::size_t i = 0; i < node.arguments.size(); ++i) {
+                if (node.arguments[i]->size >= threshold) {
+                    if (large != node.arguments.size() && forkDepth < maxForkDepth) {
+                        node.subtasks.emplace_back(large, spawn(node.arguments[large], forkDepth + 1));
+                    }
+                    large = i;
+                }
+            }
+            
+            // Normalize everything that was not forked here
+            for (std::size_t i = 0; i < node.arguments.size(); ++i) {
+                bool forked = std::any_of(node.subtasks.begin(), node.subtasks.end(),
+                                          [i](const auto& subtask) { return subtask.first == i; });
+                if (i != large && !forked) {
+                    try {
+                        node.arguments[i] = worker.reducer.normalize(node.arguments[i]);
+                    } catch (const LimitExceededError&) {
+                        node.hole = i;
+                        pending.push_back(std::move(node));
+                        throw;
+                    }
+                }
+            }
+            
+            node.hole = large;
+            if (large == node.arguments.size()) {
+                // No large argument: this subterm is finished
+                result = build(node);
+            } else {
+                term = node.arguments[large];
+            }
+            pending.push_back(std::move(node));
+        }
+        
+        // Join the subtasks and rebuild from the innermost head normal form outwards
+        pending.pop_back();
+        while (!pending.empty()) {
+            Pending& node = pending.back();
+            node.arguments[node.hole] = result;
+            
+            for (auto& [index, subtask] : node.subtasks) {
+                pool.helpUntil([&subtask = subtask] { return subtask->done.load(); });
+                if (subtask->cancelled) {
+                    throw CancelledError();
+                }
+                if (subtask->error) {
+                    node.hole = index;
+                    std::rethrow_exception(subtask->error);
+                }
+                node.arguments[index] = subtask->result;
+            }
+            
+            result = build(node);
+            pending.pop_back();
+        }
+    } catch (LimitExceededError& error) {
+        rethrowWithSpine(error);
+    } catch (const CancelledError&) {
+        // Another task failed. If it is a subtask of a pending node, its
+        // error is rethrown in the hole of that node, innermost first.
+        while (!pending.empty()) {
+            Pending& node = pending.back();
+            for (auto& [index, subtask] : node.subtasks) {
+                pool.helpUntil([&subtask = subtask] { return subtask->done.load(); });
+                if (subtask->error && !subtask->cancelled) {
+                    node.hole = index;
+                    try {
+                        std::rethrow_exception(subtask->error);
+                    } catch (LimitExceededError& error) {
+                        rethrowWithSpine(error);
+                    }
+                }
+            }
+            pending.pop_back();
+        }
+        throw;
+    }
+    return result;
+}
+
+TermPtr ParallelReducer::normalize(TermPtr term, const EvaluationLimits& limits) {
+    for (auto& worker : workers) {
+        worker->definitions.clear();
+        worker->arena.reset();
+        worker->steps = 0;
+        worker->deltaSteps = 0;
+        worker->publishedNodes = 0;
+    }
+    monitor.begin(limits);
+    sharedSteps = 0;
+    sharedNodes = 0;
+    cancelled = false;
+    failure = nullptr;
+    
+    try {
+        TermPtr result = normalizeTask(term, 0);
+        
+        // Steps and nodes since the last batch have not been checked yet; the time no longer matters
+        EvaluationStats totals;
+        collectStats(totals);
+        monitor.check(totals.betaSteps + totals.deltaSteps, totals.nodesAllocated, false);
+        return result;
+    } catch (...) {
+        // Tasks still running refer to this reducer and its arenas
+        cancelled = true;
+        pool.helpUntil([this] { return outstandingTasks == 0; });
+        try {
+            throw;
+        } catch (const CancelledError&) {
+            // The task that failed was not found on the way back
+            if (failure) {
+                std::rethrow_exception(failure);
+            }
+            throw;
+        }
+    }
+}
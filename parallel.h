@@ -0,0 +1,61 @@
+#pragma once
+
+#include "debruijn.h"
+#include "reduction.h"
+#include "threadpool.h"
+#include "environment.h"
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <vector>
+
+// Normal order reduction that normalizes independent subterms in parallel.
+// A term is first reduced to head normal form λx1...λxn.h a1...ak; once the
+// head h is a variable the arguments can no longer interact, so the large
+// ones are normalized as separate tasks on a work-stealing thread pool.
+// Arguments smaller than the threshold stay on the current thread.
+//
+// Every thread builds terms in its own arena; the result refers into all
+// of them and stays valid until the next call to normalize.
+class ParallelReducer {
+private:
+    struct Worker;
+    struct Subtask;
+    
+    Environment& environment;
+    ThreadPool pool;
+    std::size_t threshold;
+    
+    // One worker per pool thread, plus one for the calling thread
+    std::vector<std::unique_ptr<Worker>> workers;
+    
+    // Shared progress of the current evaluation
+    LimitMonitor monitor;
+    std::atomic<std::size_t> sharedSteps{0};
+    std::atomic<std::size_t> sharedNodes{0};
+    std::atomic<std::size_t> outstandingTasks{0};
+    std::atomic<bool> cancelled{false};
+    std::exception_ptr failure;             // Error of the task that cancelled the others
+    
+    Worker& currentWorker();
+    void publish(Worker& worker);
+    void fail();
+    TermPtr normalizeTask(TermPtr term, std::size_t forkDepth);
+    std::shared_ptr<Subtask> spawn(TermPtr term, std::size_t forkDepth);
+
+public:
+    // Zero threads means one per hardware thread
+    ParallelReducer(Environment& environment, std::size_t threadCount, std::size_t threshold);
+    ~ParallelReducer();
+    
+    // Reduce a term to normal form, throwing LimitExceededError past a limit.
+    // Limits are checked in batches, so they may be overrun by a few thousand steps.
+    TermPtr normalize(TermPtr term, const EvaluationLimits& limits);
+    
+    // Add the counters of the last call to normalize
+    void collectStats(EvaluationStats& stats) const;
+    
+    void setThreshold(std::size_t size) { threshold = size; }
+    std::size_t getThreshold() const { return threshold; }
+    std::size_t getThreadCount() const { return pool.getThreadCount(); }
+};
@@ -1,189 +1,172 @@
-#include "Parser.h"
+#include "parser.h"
+#include <cstdint>
 #include <sstream>
-#include <regex>
 
 // Helper methods
-char Parser::peek() const {
-    if (isAtEnd()) return '\0';
-    return input[position];
-}
-
-char Parser::current() const {
-    if (position == 0 || position > input.length()) return '\0';
-    return input[position - 1];
-}
-
-bool Parser::isAtEnd() const {
-    return position >= input.length();
-}
-
 void Parser::advance() {
-    if (!isAtEnd()) position++;
+    token = lexer.next();
 }
 
-void Parser::skipWhitespace() {
-    while (!isAtEnd() && std::isspace(peek())) {
-        advance();
+// Report the current token as unexpected, naming what was expected if given
+void Parser::unexpected(const char* expected) const {
+    std::stringstream ss;
+    if (expected) {
+        ss << "Expected " << expected << " at position " << token.position;
+    } else if (token.kind == TokenKind::End) {
+        ss << "Unexpected end of input at position " << token.position;
+    } else {
+        ss << "Unexpected character '" << token.text << "' at position " << token.position;
     }
-}
-
-bool Parser::match(char expected) {
-    if (isAtEnd() || peek() != expected) return false;
-    advance();
-    return true;
-}
-
-bool Parser::isAlpha(char c) const {
-    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
-}
-
-bool Parser::isAlphaNumeric(char c) const {
-    return isAlpha(c) || (c >= '0' && c <= '9');
+    throw ParserError(ss.str());
 }
 
 // Parsing methods
 std::shared_ptr<Expression> Parser::parse() {
-    skipWhitespace();
-    auto expr = parseExpression();
+    ExpressionBuilder builder;
+    auto expr = parseExpression(builder);
     
     // Check that we've consumed all input
-    skipWhitespace();
-    if (!isAtEnd()) {
-        std::stringstream ss;
-        ss << "Unexpected character '" << peek() << "' at position " << position;
-        throw ParserError(ss.str());
+    if (token.kind != TokenKind::End) {
+        unexpected(nullptr);
     }
     
     return expr;
 }
 
-bool Parser::parseDefinition(std::string& name, std::shared_ptr<Expression>& expr) {
-    // Regular expression to match definitions (name = expression)
-    std::regex def_regex("^\\s*([a-zA-Z][a-zA-Z0-9]*)\\s*=\\s*(.+)$");
-    std::smatch matches;
-    
-    if (std::regex_match(input, matches, def_regex)) {
-        name = matches[1];
-        
-        // Create a new parser for the expression part
-        Parser exprParser(matches[2], environment);
-        expr = exprParser.parse();
-        
-        return true;
+NodeHandle Parser::parse(NodeStore& store) {
+    NodeHandle node = parseExpression(store);
+    if (token.kind != TokenKind::End) {
+        unexpected(nullptr);
     }
-    
-    return false;
+    return node;
 }
 
-std::shared_ptr<Expression> Parser::parseExpression() {
-    return parseApplication();
-}
-
-std::shared_ptr<Expression> Parser::parseApplication() {
-    // Parse the first expression
-    auto expr = parsePrimary();
-    
-    // Look for additional expressions to create applications
-    while (true) {
-        skipWhitespace();
-        
-        // If we see another expression, it's part of the application
-        if (!isAtEnd() && (isAlpha(peek()) || peek() == '(' || peek() == 'λ' || peek() == '\\')) {
-            auto right = parsePrimary();
-            expr = std::make_shared<Application>(expr, right);
-        } else {
-            break;
-        }
+bool Parser::parseDefinition(std::string& name, std::shared_ptr<Expression>& expr) {
+    // A definition is a name followed by '='; anything else is left for parse()
+    if (token.kind != TokenKind::Identifier || lexer.peek().kind != TokenKind::Equals) {
+        return false;
     }
     
-    return expr;
+    name = std::string(token.text);
+    advance();
+    advance();
+    expr = parse();
+    
+    return true;
 }
 
-std::shared_ptr<Expression> Parser::parsePrimary() {
-    skipWhitespace();
+template <typename Builder>
+typename Builder::Handle Parser::parseExpression(Builder& builder) {
+    using Handle = typename Builder::Handle;
     
-    if (isAlpha(peek())) {
-        return parseVariable();
-    }
+    // An open parenthesis or abstraction, with the application parsed so far inside it
+    struct Frame {
+        enum Kind { Top, Parenthesis, Abstraction } kind;
+        Symbol parameter;
+        Handle expr;
+        bool empty;
+    };
     
-    if (match('(')) {
-        return parseParenthesized();
-    }
+    std::vector<Frame> frames{{Frame::Top, 0, Handle(), true}};
     
-    if (match('λ') || match('\\')) {
-        return parseAbstraction();
-    }
+    // Juxtaposition is left associative
+    auto append = [&frames, &builder](Handle operand) {
+        Frame& frame = frames.back();
+        frame.expr = frame.empty ? std::move(operand) : builder.makeApplication(std::move(frame.expr), std::move(operand));
+        frame.empty = false;
+    };
     
-    std::stringstream ss;
-    ss << "Unexpected character '" << peek() << "' at position " << position;
-    throw ParserError(ss.str());
+    while (true) {
+        switch (token.kind) {
+            case TokenKind::Identifier:
+                append(parseVariable(builder));
+                continue;
+            
+            case TokenKind::Integer:
+                append(parseInteger(builder));
+                continue;
+            
+            case TokenKind::LeftParen:
+                advance();
+                frames.push_back({Frame::Parenthesis, 0, Handle(), true});
+                continue;
+            
+            case TokenKind::Lambda: {
+                // Parse the parameter and the dot; the body extends as far right as possible
+                advance();
+                if (token.kind != TokenKind::Identifier) {
+                    unexpected("identifier");
+                }
+                Symbol parameter = internSymbol(token.text);
+                advance();
+                if (token.kind != TokenKind::Dot) {
+                    unexpected("'.' after lambda parameter");
+                }
+                advance();
+                frames.push_back({Frame::Abstraction, parameter, Handle(), true});
+                continue;
+            }
+            
+            default:
+                break;
+        }
+        
+        // Nothing more can be applied, so the abstractions opened last are complete
+        while (frames.back().kind == Frame::Abstraction) {
+            if (frames.back().empty) {
+                unexpected(nullptr);
+            }
+            auto abstraction = builder.makeAbstraction(frames.back().parameter, std::move(frames.back().expr));
+            frames.pop_back();
+            append(std::move(abstraction));
+        }
+        
+        if (frames.back().empty) {
+            unexpected(nullptr);
+        }
+        if (frames.back().kind == Frame::Top) {
+            return frames.back().expr;
+        }
+        
+        // Make sure we close the parentheses
+        if (token.kind != TokenKind::RightParen) {
+            unexpected("')'");
+        }
+        advance();
+        auto expr = std::move(frames.back().expr);
+        frames.pop_back();
+        append(std::move(expr));
+    }
 }
 
-std::shared_ptr<Expression> Parser::parseVariable() {
-    std::string name = parseIdentifier();
+template <typename Builder>
+typename Builder::Handle Parser::parseVariable(Builder& builder) {
+    Symbol name = internSymbol(token.text);
+    advance();
     
     // Check if this is a named reference to a defined expression
     if (environment.isDefined(name)) {
-        return std::make_shared<NamedReference>(name);
+        return builder.makeReference(name);
     }
     
     // Otherwise, it's just a variable
-    return std::make_shared<Variable>(name);
-}
-
-std::string Parser::parseIdentifier() {
-    std::string name;
-    
-    // First character must be alphabetic
-    if (!isAtEnd() && isAlpha(peek())) {
-        name += peek();
-        advance();
-    } else {
-        std::stringstream ss;
-        ss << "Expected identifier at position " << position;
-        throw ParserError(ss.str());
-    }
-    
-    // Subsequent characters can be alphanumeric
-    while (!isAtEnd() && isAlphaNumeric(peek())) {
-        name += peek();
-        advance();
-    }
-    
-    return name;
-}
-
-std::shared_ptr<Expression> Parser::parseAbstraction() {
-    // Parse the parameter
-    skipWhitespace();
-    std::string parameter = parseIdentifier();
-    
-    // Parse the dot
-    skipWhitespace();
-    if (!match('.')) {
-        std::stringstream ss;
-        ss << "Expected '.' after lambda parameter at position " << position;
-        throw ParserError(ss.str());
+    return builder.makeVariable(name);
+}
+
+template <typename Builder>
+typename Builder::Handle Parser::parseInteger(Builder& builder) {
+    // Literals must fit in a term's value field
+    std::size_t value = 0;
+    for (char digit : token.text) {
+        std::size_t next = value * 10 + static_cast<std::size_t>(digit - '0');
+        if (value > SIZE_MAX / 10 || next < value * 10) {
+            std::stringstream ss;
+            ss << "Integer literal too large at position " << token.position;
+            throw ParserError(ss.str());
+        }
+        value = next;
     }
+    advance();
     
-    // Parse the body
-    skipWhitespace();
-    auto body = parseExpression();
-    
-    return std::make_shared<Abstraction>(parameter, body);
+    return builder.makeInteger(value);
 }
-
-std::shared_ptr<Expression> Parser::parseParenthesized() {
-    // Parse the expression inside the parentheses
-    auto expr = parseExpression();
-    
-    // Make sure we close the parentheses
-    skipWhitespace();
-    if (!match(')')) {
-        std::stringstream ss;
-        ss << "Expected ')' at position " << position;
-        throw ParserError(ss.str());
-    }
-    
-    return expr;
-}
\ No newline at end of file
@@ -1,8 +1,11 @@
 #pragma once
 
-#include "Expression.h"
-#include "Environment.h"
+#include "expression.h"
+#include "environment.h"
+#include "lexer.h"
+#include "nodestore.h"
 #include <string>
+#include <string_view>
 #include <vector>
 #include <stdexcept>
 
@@ -12,41 +15,41 @@ public:
     explicit ParserError(const std::string& message) : std::runtime_error(message) {}
 };
 
-// Parser for lambda calculus expressions
+// Parser for lambda calculus expressions.
+// Works on the tokens of a Lexer with one token of lookahead and keeps open
+// parentheses and abstractions on an explicit stack, so parsing is linear
+// in the input and deeply nested terms cannot exhaust the native stack.
+// The input is not copied and must outlive the parser.
 class Parser {
 private:
-    std::string input;
-    size_t position = 0;
+    Lexer lexer;
+    Token token;
     Environment& environment;
     
     // Helper methods for parsing
-    char peek() const;
-    char current() const;
-    bool isAtEnd() const;
     void advance();
-    void skipWhitespace();
-    bool match(char expected);
-    bool isAlpha(char c) const;
-    bool isAlphaNumeric(char c) const;
+    [[noreturn]] void unexpected(const char* expected) const;
     
-    // Recursive descent parsing
-    std::shared_ptr<Expression> parseExpression();
-    std::shared_ptr<Expression> parseApplication();
-    std::shared_ptr<Expression> parsePrimary();
-    std::shared_ptr<Expression> parseVariable();
-    std::shared_ptr<Expression> parseAbstraction();
-    std::shared_ptr<Expression> parseParenthesized();
-    
-    // Token methods
-    std::string parseIdentifier();
+    // Parse an expression with an ExpressionBuilder or a NodeStore, stopping
+    // before the first token that cannot continue it
+    template <typename Builder>
+    typename Builder::Handle parseExpression(Builder& builder);
+    template <typename Builder>
+    typename Builder::Handle parseVariable(Builder& builder);
+    template <typename Builder>
+    typename Builder::Handle parseInteger(Builder& builder);
 
 public:
-    explicit Parser(std::string input, Environment& env) 
-        : input(std::move(input)), environment(env) {}
+    explicit Parser(std::string_view input, Environment& env)
+        : lexer(input), token(lexer.next()), environment(env) {}
     
     // Parse a lambda calculus expression from a string
     std::shared_ptr<Expression> parse();
     
-    // Parse a definition (name = expression)
+    // Parse an expression into a node store, returning the handle of its root
+    NodeHandle parse(NodeStore& store);
+    
+    // Parse a definition (name = expression). Returns false without
+    // consuming any input if the input is not a definition.
     bool parseDefinition(std::string& name, std::shared_ptr<Expression>& expr);
-};
\ No newline at end of file
+};
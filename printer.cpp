@@ -0,0 +1,426 @@
+#include "printer.h"
+#include "environment.h"
+#include <algorithm>
+#include <functional>
+#include <sstream>
+
+// Nodes the arena may hold beyond twice those of the index before it is
+// built afresh
+static constexpr std::size_t spareNodes = 1 << 16;
+
+// Builds the nameless form of an expression with every parameter hint
+// erased, so alpha-equivalent expressions give the same term. If terms is
+// given, the term of every subexpression is recorded there.
+class Canonicalizer : public ITraversal {
+private:
+    TermArena& arena;
+    std::unordered_map<const Expression*, TermPtr>* terms;
+    std::vector<TermPtr> results;
+    std::unordered_map<Symbol, std::vector<std::size_t>> binders;
+    std::size_t level = 0;
+    
+    void push(const Expression& expr, TermPtr term) {
+        if (terms) {
+            // An expression shared between places where its variables are
+            // bound differently has no single term
+            auto [it, inserted] = terms->emplace(&expr, term);
+            if (!inserted && it->second != term) {
+                it->second = nullptr;
+            }
+        }
+        results.push_back(term);
+    }
+    
+    TermPtr pop() {
+        TermPtr term = results.back();
+        results.pop_back();
+        return term;
+    }
+
+public:
+    Canonicalizer(TermArena& arena, std::unordered_map<const Expression*, TermPtr>* terms)
+        : arena(arena), terms(terms) {}
+    
+    void visit(const Variable& variable) override {
+        auto binder = binders.find(variable.getSymbol());
+        if (binder != binders.end() && !binder->second.empty()) {
+            push(variable, arena.makeBound(level - 1 - binder->second.back()));
+        } else {
+            push(variable, arena.makeFree(variable.getSymbol()));
+        }
+    }
+    
+    void visit(const NamedReference& reference) override {
+        push(reference, arena.makeReference(reference.getSymbol()));
+    }
+    
+    void visit(const IntegerLiteral& literal) override {
+        push(literal, arena.makeInteger(literal.getValue()));
+    }
+    
+    bool enter(const Abstraction& abstraction) override {
+        binders[abstraction.getParameterSymbol()].push_back(level++);
+        return true;
+    }
+    
+    void leave(const Abstraction& abstraction) override {
+        binders[abstraction.getParameterSymbol()].pop_back();
+        --level;
+        push(abstraction, arena.makeAbstraction(0, pop()));
+    }
+    
+    void leave(const Application& application) override {
+        TermPtr argument = pop();
+        TermPtr function = pop();
+        push(application, arena.makeApplication(function, argument));
+    }
+    
+    TermPtr getResult() const {
+        return results.back();
+    }
+};
+
+// Counts the occurrences of the closed subexpressions that may be worth a
+// let binding. A repeated subexpression is entered once, as it is printed
+// once, and so are subexpressions printed as the name of a definition.
+class ShareCounter : public ITraversal {
+private:
+    const std::unordered_map<const Expression*, TermPtr>& terms;
+    std::size_t minimumSize;
+    std::function<bool(TermPtr)> isNamed;
+    
+    bool count(const Expression& expr) {
+        TermPtr term = terms.at(&expr);
+        if (!term || term->scope != 0 || term->size < minimumSize) {
+            return true;
+        }
+        return ++occurrences[term] == 1 && !isNamed(term);
+    }
+    
+    void finish(const Expression& expr) {
+        if (occurrences.count(terms.at(&expr))) {
+            firstOccurrences.push_back(&expr);
+        }
+    }
+
+public:
+    std::unordered_map<TermPtr, std::size_t> occurrences;
+    
+    // First occurrences of the candidates, each after the ones it contains
+    std::vector<const Expression*> firstOccurrences;
+    
+    ShareCounter(const std::unordered_map<const Expression*, TermPtr>& terms, std::size_t minimumSize,
+                 std::function<bool(TermPtr)> isNamed)
+        : terms(terms), minimumSize(minimumSize), isNamed(std::move(isNamed)) {}
+    
+    bool enter(const Abstraction& abstraction) override { return count(abstraction); }
+    bool enter(const Application& application) override { return count(application); }
+    void leave(const Abstraction& abstraction) override { finish(abstraction); }
+    void leave(const Application& application) override { finish(application); }
+};
+
+TermArena& PrettyPrinter::getArena() {
+    if (!arena) {
+        arena = std::make_unique<TermArena>();
+    }
+    return *arena;
+}
+
+TermPtr PrettyPrinter::canonicalize(const Expression& root, bool record) {
+    Canonicalizer canonicalizer(getArena(), record ? &expressionTerms : nullptr);
+    traverse(root, canonicalizer);
+    return canonicalizer.getResult();
+}
+
+// Bring the index up to date with the changes to the environment since the
+// last update. The terms of the expressions printed stay in the arena with
+// the index, so once they outgrow it the index is built afresh.
+void PrettyPrinter::indexDefinitions() {
+    std::vector<Symbol> names;
+    if (getArena().getNodeCount() > 2 * indexedNodes + spareNodes) {
+        for (Symbol name = 0; name < indexedTerms.size(); ++name) {
+            if (!indexedTerms[name].empty()) {
+                names.push_back(name);
+            }
+        }
+        arena->reset();
+        definitionTerms.clear();
+        indexedTerms.clear();
+    }
+    
+    if (environment) {
+        const std::vector<Symbol>& changes = environment->getChanges();
+        if (changes.size() < indexedChanges) {
+            // The environment was replaced as a whole
+            for (Symbol name = 0; name < indexedTerms.size(); ++name) {
+                names.push_back(name);
+            }
+            indexedChanges = 0;
+        }
+        names.insert(names.end(), changes.begin() + static_cast<std::ptrdiff_t>(indexedChanges), changes.end());
+        indexedChanges = changes.size();
+    }
+    
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    for (Symbol name : names) {
+        reindex(name);
+    }
+    indexedNodes = arena->getNodeCount();
+}
+
+// Replace the terms indexed for a name by those of its current definition
+// and normal form
+void PrettyPrinter::reindex(Symbol name) {
+    if (name >= indexedTerms.size()) {
+        indexedTerms.resize(name + 1);
+    }
+    for (TermPtr term : indexedTerms[name]) {
+        auto names = definitionTerms.find(term);
+        names->second.erase(std::remove(names->second.begin(), names->second.end(), name), names->second.end());
+        if (names->second.empty()) {
+            definitionTerms.erase(names);
+        }
+    }
+    indexedTerms[name].clear();
+    if (!environment) {
+        return;
+    }
+    
+    for (const auto& form : {environment->findDecoded(name), environment->findDecodedNormalForm(name)}) {
+        if (!form) {
+            continue;
+        }
+        TermPtr term = canonicalize(*form, false);
+        auto& names = definitionTerms[term];
+        auto position = std::lower_bound(names.begin(), names.end(), name, [](Symbol a, Symbol b) {
+            return getSymbolName(a) < getSymbolName(b);
+        });
+        if (position == names.end() || *position != name) {
+            names.insert(position, name);
+            indexedTerms[name].push_back(term);
+        }
+    }
+}
+
+// Only closed abstractions and applications are named; a variable equal
+// to a definition is clearer printed as itself
+bool PrettyPrinter::findName(TermPtr term, Symbol& name) const {
+    if (term->scope != 0 || (term->kind != TermKind::Abstraction && term->kind != TermKind::Application)) {
+        return false;
+    }
+    auto names = definitionTerms.find(term);
+    if (names == definitionTerms.end()) {
+        return false;
+    }
+    name = names->second.front();
+    return true;
+}
+
+// First occurrences of the closed subexpressions that occur more than once,
+// each after the ones it contains
+std::vector<const Expression*> PrettyPrinter::findShared(const Expression& root) {
+    ShareCounter counter(expressionTerms, options.shareSize, [this](TermPtr term) {
+        Symbol name;
+        return options.names && findName(term, name);
+    });
+    traverse(root, counter);
+    
+    std::vector<const Expression*> shared;
+    for (const Expression* expr : counter.firstOccurrences) {
+        if (counter.occurrences[expressionTerms[expr]] > 1) {
+            shared.push_back(expr);
+        }
+    }
+    return shared;
+}
+
+// Write "..." in place of a node beyond the depth or size limit
+bool PrettyPrinter::elide() {
+    if ((options.maxSize > 0 && printed >= options.maxSize) || (options.maxDepth > 0 && depth >= options.maxDepth)) {
+        *out << "...";
+        return true;
+    }
+    ++printed;
+    return false;
+}
+
+// Write the let binding or the definition name of a subexpression that has one
+bool PrettyPrinter::abbreviate(const Expression& expr) {
+    if (expressionTerms.empty()) {
+        return false;
+    }
+    TermPtr term = expressionTerms[&expr];
+    if (!term || term == binding) {
+        return false;
+    }
+    
+    auto shared = bindings.find(term);
+    Symbol name;
+    if (shared != bindings.end()) {
+        *out << '$' << shared->second;
+        return true;
+    }
+    if (options.names && findName(term, name)) {
+        *out << getSymbolName(name);
+        return true;
+    }
+    return false;
+}
+
+void PrettyPrinter::print(std::ostream& stream, const Expression& expr) {
+    out = &stream;
+    printed = 0;
+    depth = 0;
+    binding = nullptr;
+    expressionTerms.clear();
+    bindings.clear();
+    
+    if (options.shareSize > 0 || (options.names && environment)) {
+        indexDefinitions();
+        canonicalize(expr, true);
+        
+        if (options.shareSize > 0) {
+            for (const Expression* shared : findShared(expr)) {
+                binding = expressionTerms[shared];
+                std::size_t number = bindings.size() + 1;
+                *out << "let $" << number << " = ";
+                traverse(*shared, *this);
+                *out << " in ";
+                bindings.emplace(binding, number);
+            }
+            binding = nullptr;
+        }
+    }
+    traverse(expr, *this);
+    out = nullptr;
+}
+
+std::string PrettyPrinter::toString(const Expression& expr) {
+    std::ostringstream stream;
+    print(stream, expr);
+    return stream.str();
+}
+
+void PrettyPrinter::print(std::ostream& stream, const NodeStore& store, NodeHandle root) {
+    if (options.shareSize > 0 || (options.names && environment)) {
+        print(stream, *store.toExpression(root));
+        return;
+    }
+    
+    // Node to print, or text to write once the nodes above it are printed
+    struct Item {
+        NodeHandle node;
+        const char* text;
+        std::size_t depth;
+    };
+    
+    std::vector<Item> pending{{root, nullptr, 0}};
+    std::size_t count = 0;
+    while (!pending.empty()) {
+        Item item = pending.back();
+        pending.pop_back();
+        if (item.text) {
+            stream << item.text;
+            continue;
+        }
+        if ((options.maxSize > 0 && count >= options.maxSize) || (options.maxDepth > 0 && item.depth >= options.maxDepth)) {
+            stream << "...";
+            continue;
+        }
+        ++count;
+        
+        NodeHandle node = item.node;
+        switch (store.getTag(node)) {
+            case NodeTag::Variable:
+            case NodeTag::Reference:
+                stream << getSymbolName(store.getName(node));
+                break;
+            case NodeTag::Integer:
+                stream << store.getValue(node);
+                break;
+            case NodeTag::Abstraction:
+                stream << "λ" << getSymbolName(store.getName(node)) << ".";
+                pending.push_back({store.getBody(node), nullptr, item.depth + 1});
+                break;
+            case NodeTag::Application:
+                stream << "(";
+                pending.push_back({0, ")", 0});
+                pending.push_back({store.getArgument(node), nullptr, item.depth + 1});
+                pending.push_back({0, " ", 0});
+                pending.push_back({store.getFunction(node), nullptr, item.depth + 1});
+                break;
+        }
+    }
+}
+
+std::string PrettyPrinter::toString(const NodeStore& store, NodeHandle node) {
+    std::ostringstream stream;
+    print(stream, store, node);
+    return stream.str();
+}
+
+std::vector<Symbol> PrettyPrinter::findDefinitions(const Expression& expr) {
+    if (!environment) {
+        return {};
+    }
+    
+    indexDefinitions();
+    auto names = definitionTerms.find(canonicalize(expr, false));
+    return names != definitionTerms.end() ? names->second : std::vector<Symbol>();
+}
+
+void PrettyPrinter::visit(const Variable& variable) {
+    if (!elide()) {
+        *out << variable.getName();
+    }
+}
+
+void PrettyPrinter::visit(const NamedReference& reference) {
+    if (!elide()) {
+        *out << reference.getName();
+    }
+}
+
+void PrettyPrinter::visit(const IntegerLiteral& literal) {
+    if (!elide()) {
+        *out << literal.getValue();
+    }
+}
+
+bool PrettyPrinter::enter(const Abstraction& abstraction) {
+    if (elide() || abbreviate(abstraction)) {
+        return false;
+    }
+    *out << "λ" << abstraction.getParameter() << ".";
+    ++depth;
+    return true;
+}
+
+bool PrettyPrinter::enter(const Application& application) {
+    if (elide() || abbreviate(application)) {
+        return false;
+    }
+    *out << "(";
+    ++depth;
+    return true;
+}
+
+void PrettyPrinter::separate(const Application&) {
+    *out << " ";
+}
+
+void PrettyPrinter::leave(const Abstraction&) {
+    --depth;
+}
+
+void PrettyPrinter::leave(const Application&) {
+    *out << ")";
+    --depth;
+}
+
+std::ostream& operator<<(std::ostream& out, const Expression& expr) {
+    PrettyPrinter printer;
+    printer.print(out, expr);
+    return out;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "expression.h"
+#include "visitor.h"
+#include "debruijn.h"
+#include "nodestore.h"
+#include "symbol.h"
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Environment;
+
+// How much of an expression to print, and how
+struct PrintOptions {
+    std::size_t maxDepth = 0;       // Nesting depth at which subexpressions are elided as "...", 0 for no limit
+    std::size_t maxSize = 0;        // Nodes printed before the rest is elided as "...", 0 for no limit
+    std::size_t shareSize = 0;      // Closed subexpressions of at least this many nodes that occur more
+                                    // than once are printed once, as let bindings; 0 prints every occurrence
+    bool names = false;             // Print closed subexpressions equal to a definition as its name
+};
+
+// Writes expressions to a stream in time linear in the size of the output.
+// The expression is walked by traverse, so deep expressions do not exhaust
+// the native stack. Repeated subexpressions
+// and definitions are recognized up to the names of parameters by building
+// the nameless form of the expression, in which alpha-equivalent closed
+// subexpressions are the same hash-consed term.
+class PrettyPrinter : public ITraversal {
+private:
+    PrintOptions options;
+    const Environment* environment;
+    
+    // Nameless terms with parameter names erased, built only to compare subexpressions
+    std::unique_ptr<TermArena> arena;
+    
+    // Closed terms of the definitions and their memoized normal forms, with
+    // the names equal to each in alphabetical order. The index is kept up to
+    // date from the environment's log of changes, and only holds the
+    // definitions and normal forms that need no decoding from a snapshot.
+    std::unordered_map<TermPtr, std::vector<Symbol>> definitionTerms;
+    std::vector<std::vector<TermPtr>> indexedTerms;     // Terms indexed for each name, by symbol
+    std::size_t indexedChanges = 0;                     // Changes of the environment seen
+    std::size_t indexedNodes = 0;                       // Nodes in the arena after the last update
+    
+    // State of the print in progress
+    std::ostream* out = nullptr;
+    TermPtr binding = nullptr;      // Term of the let binding being printed, which is written in full
+    std::size_t depth = 0;
+    std::size_t printed = 0;
+    std::unordered_map<const Expression*, TermPtr> expressionTerms;     // Null if ambiguous
+    std::unordered_map<TermPtr, std::size_t> bindings;                  // Number of the let binding
+    
+    TermArena& getArena();
+    TermPtr canonicalize(const Expression& root, bool record);
+    void indexDefinitions();
+    void reindex(Symbol name);
+    bool findName(TermPtr term, Symbol& name) const;
+    std::vector<const Expression*> findShared(const Expression& root);
+    bool elide();
+    bool abbreviate(const Expression& expr);
+
+public:
+    explicit PrettyPrinter(const PrintOptions& options = {}, const Environment* environment = nullptr)
+        : options(options), environment(environment) {}
+    
+    const PrintOptions& getOptions() const { return options; }
+    void setOptions(const PrintOptions& newOptions) { options = newOptions; }
+    
+    // Write an expression, preceded by its let bindings if sharing is enabled
+    void print(std::ostream& stream, const Expression& expr);
+    
+    std::string toString(const Expression& expr);
+    
+    // Write a node of a store. Without sharing or names the store is printed
+    // directly; otherwise the node is first converted to an expression.
+    void print(std::ostream& stream, const NodeStore& store, NodeHandle node);
+    
+    std::string toString(const NodeStore& store, NodeHandle node);
+    
+    // Names of the definitions equal to an expression up to the names of
+    // parameters, in alphabetical order; empty without an environment
+    std::vector<Symbol> findDefinitions(const Expression& expr);
+    
+    void visit(const Variable& variable) override;
+    void visit(const NamedReference& reference) override;
+    void visit(const IntegerLiteral& literal) override;
+    bool enter(const Abstraction& abstraction) override;
+    bool enter(const Application& application) override;
+    void separate(const Application& application) override;
+    void leave(const Abstraction& abstraction) override;
+    void leave(const Application& application) override;
+};
+
+std::ostream& operator<<(std::ostream& out, const Expression& expr);
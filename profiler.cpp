@@ -0,0 +1,272 @@
+#include "profiler.h"
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+
+// Index of no frame
+static constexpr std::size_t noFrame = std::numeric_limits<std::size_t>::max();
+
+// Name of the root of every call path
+static const char* const rootName = "<expression>";
+
+std::string getProfileMetricName(ProfileMetric metric) {
+    switch (metric) {
+        case ProfileMetric::Steps: return "steps";
+        case ProfileMetric::Nodes: return "nodes";
+        case ProfileMetric::Time: return "time";
+    }
+    return "unknown";
+}
+
+bool parseProfileMetric(const std::string& name, ProfileMetric& metric) {
+    for (auto candidate : {ProfileMetric::Steps, ProfileMetric::Nodes, ProfileMetric::Time}) {
+        if (getProfileMetricName(candidate) == name) {
+            metric = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+Profiler::Profiler() {
+    clear();
+}
+
+void Profiler::clear() {
+    frames.assign(1, Frame{0, noFrame, 0, {}});
+    children.clear();
+    running = false;
+}
+
+// Combine two 32-bit keys
+static std::uint64_t makeKey(std::uint64_t high, std::uint32_t low) {
+    return high << 32 | low;
+}
+
+// Mark the nodes of a term that are not claimed yet as owned, and record
+// the definitions it refers to. Shared subterms are visited once.
+void Profiler::claim(TermPtr term, Symbol owner) {
+    std::unordered_set<TermPtr> visited;
+    std::vector<TermPtr> stack{term};
+    while (!stack.empty()) {
+        TermPtr node = stack.back();
+        stack.pop_back();
+        if (!node || !visited.insert(node).second) {
+            continue;
+        }
+        owners.emplace(node, owner);
+        if (node->kind == TermKind::Reference) {
+            references.insert(makeKey(owner, node->name));
+        }
+        stack.push_back(node->left);
+        stack.push_back(node->right);
+    }
+}
+
+// Frame of a definition called from the current path: the frame of the
+// definition if it is on the path, or a child of its nearest caller
+std::size_t Profiler::enter(Symbol definition) {
+    std::size_t caller = noFrame;
+    for (std::size_t frame = current; frame != noFrame; frame = frames[frame].parent) {
+        if (frame != 0 && frames[frame].definition == definition) {
+            return frame;
+        }
+        if (caller == noFrame && references.count(makeKey(frames[frame].definition, definition))) {
+            caller = frame;
+        }
+    }
+    if (caller == noFrame) {
+        caller = current;
+    }
+    
+    auto [position, added] = children.emplace(makeKey(caller, definition), frames.size());
+    if (added) {
+        frames.push_back(Frame{definition, caller, 0, {}});
+    }
+    return position->second;
+}
+
+// Charge the allocations and time since the previous step to the current frame
+void Profiler::charge(std::size_t nodes) {
+    Clock::time_point now = Clock::now();
+    ProfileCosts& costs = frames[current].costs;
+    costs.nodes += nodes > lastNodes ? nodes - lastNodes : 0;
+    costs.time += std::chrono::duration_cast<std::chrono::nanoseconds>(now - lastTime);
+    lastNodes = nodes;
+    lastTime = now;
+}
+
+void Profiler::begin(TermPtr term, std::size_t nodes) {
+    owners.clear();
+    references.clear();
+    entered.clear();
+    current = 0;
+    ++frames[0].calls;
+    claim(term, 0);
+    lastNodes = nodes;
+    lastTime = Clock::now();
+    running = true;
+}
+
+void Profiler::beginLookup(std::size_t nodes) {
+    if (running) {
+        charge(nodes);
+    }
+}
+
+void Profiler::countStep(StepKind kind, Symbol definition, TermPtr term, std::size_t nodes) {
+    if (!running) {
+        return;
+    }
+    
+    if (kind == StepKind::Delta && definition != 0) {
+        current = enter(definition);
+        charge(nodes);
+        ++frames[current].calls;
+        if (definition >= entered.size()) {
+            entered.resize(definition + 1, noFrame);
+        }
+        if (entered[definition] == noFrame && term) {
+            claim(term, definition);
+        }
+        entered[definition] = current;
+        ++frames[current].costs.steps;
+        return;
+    }
+    
+    charge(nodes);
+    if (term) {
+        auto owner = owners.find(term);
+        if (owner != owners.end()) {
+            current = owner->second == 0 ? 0 : entered[owner->second];
+        }
+    }
+    ++frames[current].costs.steps;
+}
+
+void Profiler::end(std::size_t nodes) {
+    if (running) {
+        charge(nodes);
+        owners.clear();
+        references.clear();
+        running = false;
+    }
+}
+
+std::vector<ProfileEntry> Profiler::getEntries() const {
+    // Children are added after their parents, so a pass from the back sums
+    // every subtree into its root
+    std::vector<ProfileCosts> totals(frames.size());
+    for (std::size_t i = frames.size(); i-- > 0;) {
+        totals[i].steps += frames[i].costs.steps;
+        totals[i].nodes += frames[i].costs.nodes;
+        totals[i].time += frames[i].costs.time;
+        if (i > 0) {
+            ProfileCosts& parent = totals[frames[i].parent];
+            parent.steps += totals[i].steps;
+            parent.nodes += totals[i].nodes;
+            parent.time += totals[i].time;
+        }
+    }
+    
+    // A definition is on a path at most once, so its inclusive costs are
+    // the sum of the subtrees of its frames
+    std::unordered_map<Symbol, ProfileEntry> entries;
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+        const Frame& frame = frames[i];
+        ProfileEntry& entry = entries.try_emplace(frame.definition, ProfileEntry{frame.definition, 0, {}, {}}).first->second;
+        entry.calls += frame.calls;
+        entry.exclusive.steps += frame.costs.steps;
+        entry.exclusive.nodes += frame.costs.nodes;
+        entry.exclusive.time += frame.costs.time;
+        entry.inclusive.steps += totals[i].steps;
+        entry.inclusive.nodes += totals[i].nodes;
+        entry.inclusive.time += totals[i].time;
+    }
+    
+    std::vector<ProfileEntry> sorted;
+    for (auto& [definition, entry] : entries) {
+        sorted.push_back(entry);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const ProfileEntry& a, const ProfileEntry& b) {
+        if (a.inclusive.steps != b.inclusive.steps) {
+            return a.inclusive.steps > b.inclusive.steps;
+        }
+        if (a.exclusive.steps != b.exclusive.steps) {
+            return a.exclusive.steps > b.exclusive.steps;
+        }
+        return a.definition < b.definition;
+    });
+    return sorted;
+}
+
+void Profiler::writeReport(std::ostream& out) const {
+    std::vector<ProfileEntry> entries = getEntries();
+    std::uint64_t total = 0;
+    for (const ProfileEntry& entry : entries) {
+        if (entry.definition == 0) {
+            total = entry.inclusive.steps;
+        }
+    }
+    
+    auto milliseconds = [](std::chrono::nanoseconds time) {
+        return std::chrono::duration<double, std::milli>(time).count();
+    };
+    
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::left << std::setw(20) << "Definition" << std::right << std::setw(10) << "Calls"
+        << std::setw(12) << "Steps incl" << std::setw(12) << "Steps excl" << std::setw(8) << "% incl"
+        << std::setw(12) << "Nodes incl" << std::setw(12) << "Nodes excl"
+        << std::setw(10) << "ms incl" << std::setw(10) << "ms excl" << std::endl;
+    out << std::fixed;
+    for (const ProfileEntry& entry : entries) {
+        double share = total > 0 ? 100.0 * static_cast<double>(entry.inclusive.steps) / static_cast<double>(total) : 0.0;
+        out << std::left << std::setw(20) << (entry.definition ? getSymbolName(entry.definition) : rootName)
+            << std::right << std::setw(10) << entry.calls
+            << std::setw(12) << entry.inclusive.steps << std::setw(12) << entry.exclusive.steps
+            << std::setw(8) << std::setprecision(1) << share
+            << std::setw(12) << entry.inclusive.nodes << std::setw(12) << entry.exclusive.nodes
+            << std::setw(10) << std::setprecision(3) << milliseconds(entry.inclusive.time)
+            << std::setw(10) << milliseconds(entry.exclusive.time) << std::endl;
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
+
+// Names of the definitions from the root to a frame, joined by ';'
+std::string Profiler::getPath(std::size_t frame) const {
+    std::vector<Symbol> definitions;
+    for (; frame != 0; frame = frames[frame].parent) {
+        definitions.push_back(frames[frame].definition);
+    }
+    
+    std::string path = rootName;
+    for (std::size_t i = definitions.size(); i > 0; --i) {
+        path += ';';
+        path += getSymbolName(definitions[i - 1]);
+    }
+    return path;
+}
+
+void Profiler::writeCollapsedStacks(std::ostream& out, ProfileMetric metric) const {
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+        const ProfileCosts& costs = frames[i].costs;
+        std::uint64_t value = 0;
+        switch (metric) {
+            case ProfileMetric::Steps:
+                value = costs.steps;
+                break;
+            case ProfileMetric::Nodes:
+                value = costs.nodes;
+                break;
+            case ProfileMetric::Time:
+                value = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(costs.time).count());
+                break;
+        }
+        if (value > 0) {
+            out << getPath(i) << ' ' << value << '\n';
+        }
+    }
+    out.flush();
+}
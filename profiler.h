@@ -0,0 +1,121 @@
+#pragma once
+
+#include "debruijn.h"
+#include "reduction.h"
+#include "symbol.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Costs charged to a definition, or to a call path of definitions
+struct ProfileCosts {
+    std::uint64_t steps = 0;                // Reduction steps
+    std::uint64_t nodes = 0;                // Term nodes allocated
+    std::chrono::nanoseconds time{0};
+};
+
+// Totals of one definition in a profile. The inclusive costs add the costs
+// of everything the definition called to its own, exclusive costs.
+struct ProfileEntry {
+    Symbol definition;                      // 0 for the expressions evaluated
+    std::uint64_t calls = 0;                // Times unfolded, or expressions evaluated
+    ProfileCosts exclusive;
+    ProfileCosts inclusive;
+};
+
+// Cost written for each call path in collapsed stacks
+enum class ProfileMetric {
+    Steps,
+    Nodes,
+    Time                                    // In microseconds
+};
+
+// Name used for a metric in the REPL
+std::string getProfileMetricName(ProfileMetric metric);
+
+// Look up a metric by its name; returns false if the name is unknown
+bool parseProfileMetric(const std::string& name, ProfileMetric& metric);
+
+// Charges the reduction steps, allocations and time of evaluations to the
+// definitions whose bodies they came from.
+//
+// When a definition is first unfolded, the nodes of its body that no other
+// body or expression of the evaluation claimed yet are marked as its own. A
+// step applying an abstraction is charged to the owner of the abstraction;
+// terms built by substitution have no owner and are charged where the
+// previous step was. Allocations and time between two steps are charged
+// with the first of them, except that the cost of looking up a definition,
+// which may memoize its normal form, is charged to the definition.
+//
+// Costs are kept per call path. Unfolding a definition enters it below the
+// nearest definition on the current path whose body refers to it, or below
+// the current path if none does, and returns to it if it is already on the
+// path, so recursion does not make paths longer. Applying an abstraction of
+// a definition returns to the path the definition was last entered on.
+//
+// A profiler adds up every evaluation it sees until it is cleared. It is
+// used by one evaluation at a time.
+class Profiler {
+private:
+    using Clock = std::chrono::steady_clock;
+    
+    // Node of the tree of call paths; the root stands for the expressions evaluated
+    struct Frame {
+        Symbol definition;
+        std::size_t parent;
+        std::uint64_t calls;
+        ProfileCosts costs;
+    };
+    
+    std::vector<Frame> frames;
+    std::unordered_map<std::uint64_t, std::size_t> children;        // By parent frame and definition
+    
+    // State of the evaluation in progress
+    bool running = false;
+    std::unordered_map<TermPtr, Symbol> owners;
+    std::unordered_set<std::uint64_t> references;   // By the definition referring and the one referred to
+    std::vector<std::size_t> entered;       // Frame each definition was last entered on, by symbol
+    std::size_t current = 0;
+    std::size_t lastNodes = 0;
+    Clock::time_point lastTime;
+    
+    void claim(TermPtr term, Symbol owner);
+    std::size_t enter(Symbol definition);
+    void charge(std::size_t nodes);
+    std::string getPath(std::size_t frame) const;
+
+public:
+    Profiler();
+    
+    // Start an evaluation of a term, given the nodes allocated so far
+    void begin(TermPtr term, std::size_t nodes);
+    
+    // Charge the costs so far before a definition is looked up, so the
+    // costs of the lookup go to the definition when it is unfolded
+    void beginLookup(std::size_t nodes);
+    
+    // Charge one step, with the arguments of IReductionContext::countStep
+    // and the nodes allocated so far
+    void countStep(StepKind kind, Symbol definition, TermPtr term, std::size_t nodes);
+    
+    // Finish the evaluation in progress, if any
+    void end(std::size_t nodes);
+    
+    // Forget every cost recorded
+    void clear();
+    
+    // Totals of every definition charged, by decreasing inclusive steps
+    std::vector<ProfileEntry> getEntries() const;
+    
+    // Write the totals as a table
+    void writeReport(std::ostream& out) const;
+    
+    // Write one line per call path with its exclusive cost, as names joined
+    // by ';' followed by the cost: the input of flame graph tools
+    void writeCollapsedStacks(std::ostream& out, ProfileMetric metric) const;
+};
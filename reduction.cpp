@@ -0,0 +1,119 @@
+#include "reduction.h"
+#include "normalorder.h"
+#include <cstdint>
+
+// Largest Church numeral, in term nodes, read back from a native integer
+// when no node limit is set
+static constexpr std::size_t maxNumeralSize = std::size_t(1) << 24;
+
+namespace {
+
+// Context for normalizing a definition, with a step budget of its own. The
+// time and node limits are those of the evaluation it runs in; its steps
+// are not charged to the evaluation's step limit.
+class DefinitionContext : public IReductionContext {
+private:
+    TermArena& arena;
+    DefinitionCache& definitions;
+    const LimitMonitor* monitor;
+    std::size_t stepLimit;
+    std::size_t stepCount = 0;
+
+public:
+    DefinitionContext(TermArena& arena, DefinitionCache& definitions, const LimitMonitor* monitor, std::size_t stepLimit)
+        : arena(arena), definitions(definitions), monitor(monitor), stepLimit(stepLimit) {}
+    
+    TermArena& getArena() override { return arena; }
+    
+    TermPtr lookupDefinition(Symbol name) override {
+        return definitions.lookup(name);
+    }
+    
+    void countStep(StepKind, Symbol, TermPtr) override {
+        if (++stepCount > stepLimit) {
+            throw EvaluationError("Definition has no normal form within the limit");
+        }
+        if (monitor) {
+            monitor->check(0, arena.getNodeCount(), stepCount % 1024 == 0);
+        }
+    }
+    
+    // Definitions are normalized in normal order, which holds no machine objects
+    void countMachineNodes(std::size_t) override {}
+};
+
+}
+
+void LimitMonitor::begin(const EvaluationLimits& newLimits) {
+    limits = newLimits;
+    start = std::chrono::steady_clock::now();
+}
+
+void LimitMonitor::check(std::size_t steps, std::size_t nodes, bool checkTime) const {
+    if (limits.maxSteps > 0 && steps > limits.maxSteps) {
+        throw LimitExceededError("Step limit of " + std::to_string(limits.maxSteps) + " reductions exceeded");
+    }
+    if (limits.maxNodes > 0 && nodes > limits.maxNodes) {
+        throw LimitExceededError("Node limit of " + std::to_string(limits.maxNodes) + " nodes exceeded");
+    }
+    if (checkTime && limits.maxTime.count() > 0 && std::chrono::steady_clock::now() - start > limits.maxTime) {
+        throw LimitExceededError("Time limit of " + std::to_string(limits.maxTime.count()) + " ms exceeded");
+    }
+}
+
+void LimitMonitor::checkNumeral(std::size_t steps, std::size_t nodes, std::size_t numeralNodes) const {
+    if (limits.maxNodes == 0 && numeralNodes > maxNumeralSize) {
+        throw LimitExceededError("Result numeral of " + std::to_string(numeralNodes) + " term nodes is too large to read back");
+    }
+    check(steps, numeralNodes > SIZE_MAX - nodes ? SIZE_MAX : nodes + numeralNodes, true);
+}
+
+std::chrono::microseconds LimitMonitor::elapsed() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+}
+
+TermPtr DefinitionCache::lookup(Symbol name) {
+    if (name < terms.size() && terms[name]) {
+        return terms[name];
+    }
+    
+    if (!environment.isDefined(name)) {
+        return nullptr;
+    }
+    
+    // Definitions are closed with respect to bound variables, so they
+    // can be used at any depth without shifting. A definition loaded from a
+    // snapshot is only decoded if its normal form was not saved with it.
+    std::shared_ptr<Expression> normalForm;
+    bool memoized = environment.getNormalForm(name, normalForm);
+    auto term = toDeBruijn(arena, normalForm ? *normalForm : *environment.lookup(name));
+    if (name >= terms.size()) {
+        terms.resize(name + 1, nullptr);
+    }
+    terms[name] = term;
+    
+    if (!memoized && normalizeLimit > 0) {
+        terms[name] = normalize(name, term);
+    }
+    return terms[name];
+}
+
+// Normalize a definition and memoize the result. While this runs the
+// definition maps to its raw form, so a definition referring to itself
+// simply runs out of steps.
+TermPtr DefinitionCache::normalize(Symbol name, TermPtr definition) {
+    DefinitionContext context(arena, *this, monitor, normalizeLimit);
+    NormalOrderReducer reducer(context);
+    try {
+        TermPtr normalForm = reducer.normalize(definition);
+        environment.setNormalForm(name, fromDeBruijn(normalForm));
+        return normalForm;
+    } catch (LimitExceededError& error) {
+        // The evaluation stops; the definition half reduced is not its partial result
+        error.setPartialResult(nullptr);
+        throw;
+    } catch (const EvaluationError&) {
+        environment.setNormalForm(name, nullptr);
+        return definition;
+    }
+}
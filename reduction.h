@@ -0,0 +1,158 @@
+#pragma once
+
+#include "debruijn.h"
+#include "environment.h"
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Custom exception for evaluation errors
+class EvaluationError : public std::runtime_error {
+public:
+    explicit EvaluationError(const std::string& message) : std::runtime_error(message) {}
+};
+
+// Thrown when an evaluation exceeds one of its limits. Engines that can
+// rebuild the term they were working on attach it as a partial result.
+class LimitExceededError : public EvaluationError {
+private:
+    TermPtr partialResult = nullptr;
+
+public:
+    explicit LimitExceededError(const std::string& message) : EvaluationError(message) {}
+    
+    TermPtr getPartialResult() const { return partialResult; }
+    void setPartialResult(TermPtr term) { partialResult = term; }
+};
+
+// Kinds of reduction steps
+enum class StepKind {
+    Beta,           // An abstraction applied to an argument
+    Delta,          // A definition unfolded
+    Native          // A native term unfolded or a primitive applied, counted as a delta step
+};
+
+// Limits on a single evaluation; zero means unlimited
+struct EvaluationLimits {
+    std::size_t maxSteps = 1000000;         // Beta and delta steps
+    std::chrono::milliseconds maxTime{0};   // Wall clock time
+    std::size_t maxNodes = 0;               // Distinct term nodes built plus objects held by a machine
+};
+
+// Counters collected during a single evaluation
+struct EvaluationStats {
+    std::size_t betaSteps = 0;
+    std::size_t deltaSteps = 0;
+    std::size_t renames = 0;                // Parameters renamed to avoid capture in the result
+    std::size_t nodesAllocated = 0;         // Distinct term nodes built
+    std::size_t peakTermSize = 0;           // Size of the largest term built, in nodes
+    std::size_t machineNodes = 0;           // Most objects an engine held outside the term arena
+    std::chrono::microseconds elapsed{0};
+    std::string stopReason;                 // Why a limit stopped the evaluation, empty if it did not
+};
+
+// Checks the counters of one evaluation against its limits
+class LimitMonitor {
+private:
+    EvaluationLimits limits;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    // Start timing an evaluation under the given limits
+    void begin(const EvaluationLimits& newLimits);
+    
+    // Throw LimitExceededError if a limit is exceeded. Reading the clock is
+    // comparatively slow, so the time limit is only checked when asked.
+    void check(std::size_t steps, std::size_t nodes, bool checkTime) const;
+    
+    // Check the limits before native integers are expanded into Church
+    // numerals of numeralNodes nodes, as reading back a large integer
+    // allocates far more than the steps that computed it. Without a node
+    // limit, numerals of more than 2^24 nodes are refused.
+    void checkNumeral(std::size_t steps, std::size_t nodes, std::size_t numeralNodes) const;
+    
+    // Time since begin
+    std::chrono::microseconds elapsed() const;
+};
+
+// Services an evaluation engine needs from the evaluation that runs it
+class IReductionContext {
+public:
+    virtual ~IReductionContext() = default;
+    
+    // Arena holding the terms of the current evaluation
+    virtual TermArena& getArena() = 0;
+    
+    // Nameless form of a definition, or null if the name is not defined
+    virtual TermPtr lookupDefinition(Symbol name) = 0;
+    
+    // Charge one reduction step against the limits. For tracing and
+    // profiling, an engine passes the definition a delta step unfolds and
+    // the term the step starts from (the abstraction applied, the body of
+    // the definition or the native term) when it has them.
+    virtual void countStep(StepKind kind, Symbol definition = 0, TermPtr term = nullptr) = 0;
+    
+    // Charge the objects an engine holds outside the arena (closures,
+    // thunks, environments and stack frames) against the node limit, given
+    // their total. Machines allocate many of them without taking a step.
+    virtual void countMachineNodes(std::size_t nodes) = 0;
+};
+
+// Reports the objects held by an engine to its context each time their
+// total grows by a batch past the last report, so keeping it up to date
+// costs the engine a comparison
+class MachineNodeCounter {
+private:
+    static constexpr std::size_t batch = 4096;
+    
+    IReductionContext& context;
+    std::size_t next = batch;
+
+public:
+    explicit MachineNodeCounter(IReductionContext& context) : context(context) {}
+    
+    void update(std::size_t nodes) {
+        if (nodes >= next) {
+            context.countMachineNodes(nodes);
+            next = nodes + batch;
+        }
+    }
+};
+
+// Nameless forms of the definitions used during one evaluation, converted
+// into the evaluation's arena on first use and indexed by symbol.
+// With a normalization limit, each definition is reduced to normal form the
+// first time it is used and the result memoized in the environment, so later
+// evaluations start from the normal form. Definitions with no normal form
+// within the limit are used as written. Normalizing also stops when the
+// time or node limit of the evaluation's monitor, if given, is exceeded;
+// then nothing is memoized and the LimitExceededError reaches the
+// evaluation. Without a limit the cache only reads memoized normal forms
+// and never modifies the environment, so several caches may share one
+// environment across threads.
+class DefinitionCache {
+private:
+    Environment& environment;
+    TermArena& arena;
+    const LimitMonitor* monitor;
+    std::vector<TermPtr> terms;
+    std::size_t normalizeLimit;
+    
+    TermPtr normalize(Symbol name, TermPtr definition);
+
+public:
+    DefinitionCache(Environment& environment, TermArena& arena, std::size_t normalizeLimit = 0,
+                    const LimitMonitor* monitor = nullptr)
+        : environment(environment), arena(arena), monitor(monitor), normalizeLimit(normalizeLimit) {}
+    
+    // Nameless form of a definition, or null if the name is not defined
+    TermPtr lookup(Symbol name);
+    
+    // Forget the converted definitions, before the arena is reset
+    void clear() { terms.clear(); }
+    
+    // Maximum steps spent normalizing one definition; zero disables memoization
+    void setNormalizeLimit(std::size_t limit) { normalizeLimit = limit; }
+    std::size_t getNormalizeLimit() const { return normalizeLimit; }
+};
@@ -0,0 +1,488 @@
+#include "snapshot.h"
+#include "environment.h"
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// File layout, in the byte order of the machine that wrote it:
+//   Header
+//   String offsets: stringCount + 1 uint32, then the characters of every name
+//   Nodes: nodeCount Node records; children always precede their parents
+//   Definitions: definitionCount Definition records
+//   References: referenceCount uint32 string indices
+// Every section starts at a multiple of four bytes.
+
+static const char snapshotMagic[8] = {'L', 'A', 'M', 'B', 'D', 'A', 'S', 'N'};
+static constexpr std::uint32_t snapshotByteOrder = 0x01020304;
+static constexpr std::uint32_t snapshotVersion = 2;
+
+// Marks a missing node, such as the normal form of a definition that has none
+static constexpr std::uint32_t noNode = 0xFFFFFFFF;
+
+struct SnapshotHeader {
+    char magic[8];
+    std::uint32_t byteOrder;
+    std::uint32_t version;
+    std::uint32_t stringCount;
+    std::uint32_t nodeCount;
+    std::uint32_t definitionCount;
+    std::uint32_t referenceCount;
+    std::uint64_t stringOffset;
+    std::uint64_t nodeOffset;
+    std::uint64_t definitionOffset;
+    std::uint64_t referenceOffset;
+    std::uint64_t fileSize;
+};
+
+// Kinds of nodes, one per Expression class
+enum class SnapshotNodeKind : std::uint32_t {
+    Variable,       // name
+    Abstraction,    // name is the parameter, left the body
+    Application,    // left is the function, right the argument
+    Reference,      // name
+    Integer         // left and right are the low and high halves of the value
+};
+
+struct Snapshot::Node {
+    SnapshotNodeKind kind;
+    std::uint32_t name;
+    std::uint32_t left;
+    std::uint32_t right;
+};
+
+struct Snapshot::Definition {
+    std::uint32_t name;
+    std::uint32_t definition;
+    std::uint32_t normalForm;       // noNode if the definition has no normal form
+    std::uint32_t normalized;       // Whether normalForm was memoized
+    std::uint32_t referenceBegin;
+    std::uint32_t referenceCount;
+};
+
+static std::uint64_t alignSection(std::uint64_t offset) {
+    return (offset + 3) & ~static_cast<std::uint64_t>(3);
+}
+
+// Read-only memory mapping of a whole file
+class Snapshot::MappedFile {
+private:
+    const std::byte* data = nullptr;
+    std::size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER fileSize;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize)) {
+            throw SnapshotError("Cannot open '" + path + "'");
+        }
+        size = static_cast<std::size_t>(fileSize.QuadPart);
+        if (size > 0) {
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            data = mapping ? static_cast<const std::byte*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+            if (!data) {
+                throw SnapshotError("Cannot map '" + path + "'");
+            }
+        }
+#else
+        int descriptor = open(path.c_str(), O_RDONLY);
+        struct stat status;
+        if (descriptor < 0 || fstat(descriptor, &status) != 0) {
+            if (descriptor >= 0) {
+                close(descriptor);
+            }
+            throw SnapshotError("Cannot open '" + path + "'");
+        }
+        size = static_cast<std::size_t>(status.st_size);
+        if (size > 0) {
+            void* memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (memory == MAP_FAILED) {
+                close(descriptor);
+                throw SnapshotError("Cannot map '" + path + "'");
+            }
+            data = static_cast<const std::byte*>(memory);
+        }
+        // The mapping stays valid after the descriptor is closed
+        close(descriptor);
+#endif
+    }
+    
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data) {
+            UnmapViewOfFile(data);
+        }
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+#else
+        if (data) {
+            munmap(const_cast<std::byte*>(data), size);
+        }
+#endif
+    }
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    const std::byte* getData() const { return data; }
+    std::size_t getSize() const { return size; }
+};
+
+// Check that a section of count records of the given size lies inside the file
+static bool sectionFits(std::uint64_t offset, std::uint64_t count, std::uint64_t recordSize, std::uint64_t fileSize) {
+    return offset % 4 == 0 && offset <= fileSize && count <= (fileSize - offset) / recordSize;
+}
+
+Snapshot::Snapshot(const std::string& path) : file(std::make_unique<MappedFile>(path)) {
+    const std::byte* data = file->getData();
+    std::size_t size = file->getSize();
+    
+    SnapshotHeader header;
+    if (size < sizeof(header)) {
+        throw SnapshotError("'" + path + "' is not a snapshot");
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, snapshotMagic, sizeof(snapshotMagic)) != 0) {
+        throw SnapshotError("'" + path + "' is not a snapshot");
+    }
+    if (header.byteOrder != snapshotByteOrder || header.version != snapshotVersion) {
+        throw SnapshotError("'" + path + "' was written by an incompatible version");
+    }
+    
+    // Only the section bounds are checked here; nodes are checked as they are decoded
+    std::uint64_t stringCount = header.stringCount;
+    bool valid = header.fileSize == size
+        && sectionFits(header.stringOffset, stringCount + 1, sizeof(std::uint32_t), size)
+        && sectionFits(header.nodeOffset, header.nodeCount, sizeof(Node), size)
+        && sectionFits(header.definitionOffset, header.definitionCount, sizeof(Definition), size)
+        && sectionFits(header.referenceOffset, header.referenceCount, sizeof(std::uint32_t), size);
+    if (!valid) {
+        throw SnapshotError("'" + path + "' is truncated or corrupt");
+    }
+    
+    nodes = reinterpret_cast<const Node*>(data + header.nodeOffset);
+    nodeCount = header.nodeCount;
+    definitions = reinterpret_cast<const Definition*>(data + header.definitionOffset);
+    definitionCount = header.definitionCount;
+    references = reinterpret_cast<const std::uint32_t*>(data + header.referenceOffset);
+    referenceCount = header.referenceCount;
+    
+    const auto* offsets = reinterpret_cast<const std::uint32_t*>(data + header.stringOffset);
+    const char* characters = reinterpret_cast<const char*>(offsets + stringCount + 1);
+    std::uint64_t available = size - (header.stringOffset + (stringCount + 1) * sizeof(std::uint32_t));
+    symbols.reserve(stringCount);
+    for (std::uint64_t i = 0; i < stringCount; ++i) {
+        if (offsets[i] > offsets[i + 1] || offsets[i + 1] > available) {
+            throw SnapshotError("'" + path + "' is truncated or corrupt");
+        }
+        symbols.push_back(internSymbol(std::string_view(characters + offsets[i], offsets[i + 1] - offsets[i])));
+    }
+    
+    for (std::uint32_t i = 0; i < definitionCount; ++i) {
+        const Definition& record = definitions[i];
+        bool inRange = record.name < symbols.size()
+            && record.referenceBegin <= referenceCount
+            && record.referenceCount <= referenceCount - record.referenceBegin;
+        if (!inRange) {
+            throw SnapshotError("'" + path + "' is truncated or corrupt");
+        }
+    }
+}
+
+Snapshot::~Snapshot() = default;
+
+const Snapshot::Definition& Snapshot::definition(std::size_t index) const {
+    return definitions[index];
+}
+
+Symbol Snapshot::getName(std::size_t index) const {
+    return symbols[definition(index).name];
+}
+
+std::vector<Symbol> Snapshot::getReferences(std::size_t index) const {
+    const Definition& record = definition(index);
+    std::vector<Symbol> names;
+    for (std::uint32_t i = 0; i < record.referenceCount; ++i) {
+        std::uint32_t name = references[record.referenceBegin + i];
+        if (name >= symbols.size()) {
+            throw SnapshotError("Snapshot is corrupt: name index out of range");
+        }
+        names.push_back(symbols[name]);
+    }
+    return names;
+}
+
+bool Snapshot::hasNormalForm(std::size_t index) const {
+    return definition(index).normalized != 0;
+}
+
+std::shared_ptr<Expression> Snapshot::decodeDefinition(std::size_t index) const {
+    return decode(definition(index).definition);
+}
+
+std::shared_ptr<Expression> Snapshot::decodeNormalForm(std::size_t index) const {
+    std::uint32_t normalForm = definition(index).normalForm;
+    return normalForm == noNode ? nullptr : decode(normalForm);
+}
+
+// Build the expression for a node and every node below it that has not been
+// decoded yet. Uses an explicit stack so deep terms do not exhaust the native stack.
+std::shared_ptr<Expression> Snapshot::decode(std::uint32_t root) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (root >= nodeCount) {
+        throw SnapshotError("Snapshot is corrupt: node index out of range");
+    }
+    if (decoded.empty()) {
+        decoded.resize(nodeCount);
+    }
+    
+    std::vector<std::uint32_t> pending{root};
+    while (!pending.empty()) {
+        std::uint32_t index = pending.back();
+        if (decoded[index]) {
+            pending.pop_back();
+            continue;
+        }
+        
+        // Children precede their parents, which also rules out cycles
+        const Node& node = nodes[index];
+        bool hasName = node.kind != SnapshotNodeKind::Application && node.kind != SnapshotNodeKind::Integer;
+        bool hasLeft = node.kind == SnapshotNodeKind::Abstraction || node.kind == SnapshotNodeKind::Application;
+        bool hasRight = node.kind == SnapshotNodeKind::Application;
+        bool valid = node.kind <= SnapshotNodeKind::Integer
+            && (!hasName || node.name < symbols.size())
+            && (!hasLeft || node.left < index)
+            && (!hasRight || node.right < index);
+        if (!valid) {
+            throw SnapshotError("Snapshot is corrupt: invalid node " + std::to_string(index));
+        }
+        
+        bool ready = true;
+        if (hasLeft && !decoded[node.left]) {
+            pending.push_back(node.left);
+            ready = false;
+        }
+        if (hasRight && !decoded[node.right]) {
+            pending.push_back(node.right);
+            ready = false;
+        }
+        if (!ready) {
+            continue;
+        }
+        
+        pending.pop_back();
+        switch (node.kind) {
+            case SnapshotNodeKind::Variable:
+                decoded[index] = std::make_shared<Variable>(symbols[node.name]);
+                break;
+            case SnapshotNodeKind::Abstraction:
+                decoded[index] = std::make_shared<Abstraction>(symbols[node.name], decoded[node.left]);
+                break;
+            case SnapshotNodeKind::Application:
+                decoded[index] = std::make_shared<Application>(decoded[node.left], decoded[node.right]);
+                break;
+            case SnapshotNodeKind::Reference:
+                decoded[index] = std::make_shared<NamedReference>(symbols[node.name]);
+                break;
+            case SnapshotNodeKind::Integer:
+                decoded[index] = std::make_shared<IntegerLiteral>(static_cast<std::size_t>(
+                    static_cast<std::uint64_t>(node.right) << 32 | node.left));
+                break;
+        }
+    }
+    
+    return decoded[root];
+}
+
+namespace {
+
+// Encodes expressions as snapshot nodes, storing structurally equal subterms once
+class SnapshotWriter {
+private:
+    struct NodeKey {
+        std::uint32_t kind, name, left, right;
+        bool operator==(const NodeKey& other) const {
+            return kind == other.kind && name == other.name && left == other.left && right == other.right;
+        }
+    };
+    
+    struct NodeKeyHash {
+        std::size_t operator()(const NodeKey& key) const {
+            std::size_t hash = key.kind;
+            for (std::uint32_t value : {key.name, key.left, key.right}) {
+                hash = hash * 0x9e3779b97f4a7c15ULL + value;
+            }
+            return hash;
+        }
+    };
+    
+    std::unordered_map<NodeKey, std::uint32_t, NodeKeyHash> uniqueNodes;
+    std::unordered_map<const Expression*, std::uint32_t> encodedExpressions;
+    std::unordered_map<Symbol, std::uint32_t> stringIndices;
+
+public:
+    std::vector<Snapshot::Node> nodes;
+    std::vector<Symbol> strings;
+    
+    std::uint32_t string(Symbol symbol) {
+        auto [it, inserted] = stringIndices.emplace(symbol, static_cast<std::uint32_t>(strings.size()));
+        if (inserted) {
+            strings.push_back(symbol);
+        }
+        return it->second;
+    }
+    
+    std::uint32_t node(SnapshotNodeKind kind, std::uint32_t name, std::uint32_t left, std::uint32_t right) {
+        NodeKey key{static_cast<std::uint32_t>(kind), name, left, right};
+        auto [it, inserted] = uniqueNodes.emplace(key, static_cast<std::uint32_t>(nodes.size()));
+        if (inserted) {
+            if (nodes.size() >= noNode) {
+                throw SnapshotError("Environment is too large for a snapshot");
+            }
+            nodes.push_back(Snapshot::Node{kind, name, left, right});
+        }
+        return it->second;
+    }
+    
+    // Encode an expression after its subexpressions, so children precede parents
+    std::uint32_t encode(const Expression* root) {
+        std::vector<std::pair<const Expression*, bool>> pending{{root, false}};
+        while (!pending.empty()) {
+            auto [expr, childrenDone] = pending.back();
+            pending.pop_back();
+            if (encodedExpressions.count(expr)) {
+                continue;
+            }
+            
+            std::uint32_t index;
+            if (auto variable = dynamic_cast<const Variable*>(expr)) {
+                index = node(SnapshotNodeKind::Variable, string(variable->getSymbol()), 0, 0);
+            } else if (auto reference = dynamic_cast<const NamedReference*>(expr)) {
+                index = node(SnapshotNodeKind::Reference, string(reference->getSymbol()), 0, 0);
+            } else if (auto literal = dynamic_cast<const IntegerLiteral*>(expr)) {
+                auto value = static_cast<std::uint64_t>(literal->getValue());
+                index = node(SnapshotNodeKind::Integer, 0, static_cast<std::uint32_t>(value), static_cast<std::uint32_t>(value >> 32));
+            } else if (auto abstraction = dynamic_cast<const Abstraction*>(expr)) {
+                const Expression* body = abstraction->getBody().get();
+                if (!childrenDone) {
+                    pending.push_back({expr, true});
+                    pending.push_back({body, false});
+                    continue;
+                }
+                index = node(SnapshotNodeKind::Abstraction, string(abstraction->getParameterSymbol()), encodedExpressions[body], 0);
+            } else if (auto application = dynamic_cast<const Application*>(expr)) {
+                const Expression* function = application->getFunction().get();
+                const Expression* argument = application->getArgument().get();
+                if (!childrenDone) {
+                    pending.push_back({expr, true});
+                    pending.push_back({argument, false});
+                    pending.push_back({function, false});
+                    continue;
+                }
+                index = node(SnapshotNodeKind::Application, 0, encodedExpressions[function], encodedExpressions[argument]);
+            } else {
+                throw SnapshotError("Expression cannot be stored in a snapshot");
+            }
+            encodedExpressions[expr] = index;
+        }
+        return encodedExpressions[root];
+    }
+};
+
+template <typename T>
+void writeRecords(std::ofstream& out, const std::vector<T>& records) {
+    out.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(T)));
+}
+
+void padSection(std::ofstream& out) {
+    static const char zeros[4] = {0, 0, 0, 0};
+    auto position = static_cast<std::uint64_t>(out.tellp());
+    out.write(zeros, static_cast<std::streamsize>(alignSection(position) - position));
+}
+
+}
+
+void saveSnapshot(const Environment& environment, const std::string& path) {
+    SnapshotWriter writer;
+    std::vector<Snapshot::Definition> definitions;
+    std::vector<std::uint32_t> references;
+    
+    for (Symbol name : environment.getNames()) {
+        Snapshot::Definition record{};
+        record.name = writer.string(name);
+        record.definition = writer.encode(environment.lookup(name).get());
+        
+        std::shared_ptr<Expression> normalForm;
+        record.normalized = environment.getNormalForm(name, normalForm) ? 1 : 0;
+        record.normalForm = normalForm ? writer.encode(normalForm.get()) : noNode;
+        
+        record.referenceBegin = static_cast<std::uint32_t>(references.size());
+        for (Symbol reference : environment.getReferences(name)) {
+            references.push_back(writer.string(reference));
+        }
+        record.referenceCount = static_cast<std::uint32_t>(references.size()) - record.referenceBegin;
+        definitions.push_back(record);
+    }
+    
+    std::vector<std::uint32_t> stringOffsets{0};
+    std::string characters;
+    for (Symbol symbol : writer.strings) {
+        characters += getSymbolName(symbol);
+        stringOffsets.push_back(static_cast<std::uint32_t>(characters.size()));
+    }
+    
+    SnapshotHeader header{};
+    std::memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+    header.byteOrder = snapshotByteOrder;
+    header.version = snapshotVersion;
+    header.stringCount = static_cast<std::uint32_t>(writer.strings.size());
+    header.nodeCount = static_cast<std::uint32_t>(writer.nodes.size());
+    header.definitionCount = static_cast<std::uint32_t>(definitions.size());
+    header.referenceCount = static_cast<std::uint32_t>(references.size());
+    header.stringOffset = alignSection(sizeof(header));
+    header.nodeOffset = alignSection(header.stringOffset + stringOffsets.size() * sizeof(std::uint32_t) + characters.size());
+    header.definitionOffset = header.nodeOffset + writer.nodes.size() * sizeof(Snapshot::Node);
+    header.referenceOffset = header.definitionOffset + definitions.size() * sizeof(Snapshot::Definition);
+    header.fileSize = header.referenceOffset + references.size() * sizeof(std::uint32_t);
+    
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw SnapshotError("Cannot write '" + path + "'");
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    padSection(out);
+    writeRecords(out, stringOffsets);
+    out.write(characters.data(), static_cast<std::streamsize>(characters.size()));
+    padSection(out);
+    writeRecords(out, writer.nodes);
+    writeRecords(out, definitions);
+    writeRecords(out, references);
+    if (!out.flush()) {
+        throw SnapshotError("Cannot write '" + path + "'");
+    }
+}
+
+std::size_t loadSnapshot(Environment& environment, const std::string& path) {
+    auto snapshot = std::make_shared<const Snapshot>(path);
+    environment.define(snapshot);
+    return snapshot->getDefinitionCount();
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "expression.h"
+#include "symbol.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class Environment;
+
+// Custom exception for snapshot files that cannot be written or read
+class SnapshotError : public std::runtime_error {
+public:
+    explicit SnapshotError(const std::string& message) : std::runtime_error(message) {}
+};
+
+// Read-only view of a snapshot file mapped into memory.
+// A snapshot holds the definitions of an environment and their memoized
+// normal forms as one graph of fixed-size nodes in which structurally equal
+// subterms are stored once. Opening a snapshot maps the file and interns
+// its names; nodes are decoded into expressions only when a definition is
+// looked up, and each node at most once.
+class Snapshot {
+public:
+    struct Node;
+    struct Definition;
+
+private:
+    class MappedFile;
+    
+    std::unique_ptr<MappedFile> file;
+    const Node* nodes = nullptr;
+    std::uint32_t nodeCount = 0;
+    const Definition* definitions = nullptr;
+    std::uint32_t definitionCount = 0;
+    const std::uint32_t* references = nullptr;
+    std::uint32_t referenceCount = 0;
+    
+    // Symbols of the names in the file, by their index there
+    std::vector<Symbol> symbols;
+    
+    // Expressions decoded so far, by node index; shared between threads
+    mutable std::mutex mutex;
+    mutable std::vector<std::shared_ptr<Expression>> decoded;
+    
+    const Definition& definition(std::size_t index) const;
+    std::shared_ptr<Expression> decode(std::uint32_t root) const;
+
+public:
+    // Map a snapshot file, throwing SnapshotError if it is not a valid snapshot
+    explicit Snapshot(const std::string& path);
+    ~Snapshot();
+    
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+    
+    // Number of definitions in the file
+    std::size_t getDefinitionCount() const { return definitionCount; }
+    
+    // Name of a definition
+    Symbol getName(std::size_t index) const;
+    
+    // Names a definition refers to
+    std::vector<Symbol> getReferences(std::size_t index) const;
+    
+    // Whether the normal form of a definition was memoized when it was saved
+    bool hasNormalForm(std::size_t index) const;
+    
+    // Decode a definition, or its memoized normal form; the normal form is
+    // null if the definition had none within the step limit
+    std::shared_ptr<Expression> decodeDefinition(std::size_t index) const;
+    std::shared_ptr<Expression> decodeNormalForm(std::size_t index) const;
+};
+
+// Write every definition of an environment, with the normal forms memoized
+// so far, to a snapshot file
+void saveSnapshot(const Environment& environment, const std::string& path);
+
+// Map a snapshot file and add its definitions to an environment, replacing
+// definitions of the same names. Returns the number of definitions added.
+std::size_t loadSnapshot(Environment& environment, const std::string& path);
@@ -0,0 +1,85 @@
+#include "symbol.h"
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace {
+
+// Global symbol table. Names live in a deque so references to them stay
+// valid as the table grows; the index maps views of those names back to
+// their symbols. Parsing may run on several threads, hence the lock.
+class SymbolTable {
+private:
+    mutable std::shared_mutex mutex;
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, Symbol> index;
+
+public:
+    SymbolTable() {
+        intern("");
+    }
+    
+    Symbol intern(std::string_view name) {
+        {
+            std::shared_lock lock(mutex);
+            auto it = index.find(name);
+            if (it != index.end()) {
+                return it->second;
+            }
+        }
+        
+        std::unique_lock lock(mutex);
+        auto it = index.find(name);
+        if (it != index.end()) {
+            return it->second;
+        }
+        Symbol symbol = static_cast<Symbol>(names.size());
+        names.emplace_back(name);
+        index.emplace(names.back(), symbol);
+        return symbol;
+    }
+    
+    bool find(std::string_view name, Symbol& symbol) const {
+        std::shared_lock lock(mutex);
+        auto it = index.find(name);
+        if (it == index.end()) {
+            return false;
+        }
+        symbol = it->second;
+        return true;
+    }
+    
+    const std::string& name(Symbol symbol) const {
+        std::shared_lock lock(mutex);
+        return names[symbol];
+    }
+    
+    std::size_t size() const {
+        std::shared_lock lock(mutex);
+        return names.size();
+    }
+};
+
+SymbolTable& table() {
+    static SymbolTable instance;
+    return instance;
+}
+
+}
+
+Symbol internSymbol(std::string_view name) {
+    return table().intern(name);
+}
+
+bool findSymbol(std::string_view name, Symbol& symbol) {
+    return table().find(name, symbol);
+}
+
+const std::string& getSymbolName(Symbol symbol) {
+    return table().name(symbol);
+}
+
+std::size_t getSymbolCount() {
+    return table().size();
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Interned name. Every distinct name is stored once in a global table and
+// identified by a small dense integer, so names compare and hash as integers
+// and can index vectors directly. Symbol 0 is the empty name.
+using Symbol = std::uint32_t;
+
+// Return the symbol for a name, adding it to the table on first use
+Symbol internSymbol(std::string_view name);
+
+// Find the symbol for a name without adding it; returns false if the name was never interned
+bool findSymbol(std::string_view name, Symbol& symbol);
+
+// Name of a symbol; the reference stays valid for the lifetime of the program
+const std::string& getSymbolName(Symbol symbol);
+
+// Number of symbols interned so far; every symbol is below this
+std::size_t getSymbolCount();
@@ -0,0 +1,99 @@
+#include "threadpool.h"
+
+// Pool and index of the worker running on this thread
+static thread_local const ThreadPool* currentPool = nullptr;
+static thread_local std::size_t currentIndex = 0;
+
+ThreadPool::ThreadPool(std::size_t threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    
+    for (std::size_t i = 0; i <= threadCount; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (std::size_t i = 0; i < threadCount; ++i) {
+        threads.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+std::size_t ThreadPool::getWorkerIndex() const {
+    return currentPool == this ? currentIndex : threads.size();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    Queue& queue = *queues[getWorkerIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        ++queuedTasks;
+    }
+    wakeUp.notify_one();
+}
+
+// Run one task: the newest from our own queue, otherwise the oldest from another
+bool ThreadPool::runOne(std::size_t self) {
+    std::function<void()> task;
+    
+    for (std::size_t offset = 0; offset < queues.size() && !task; ++offset) {
+        Queue& queue = *queues[(self + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (offset == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+    
+    if (!task) {
+        return false;
+    }
+    --queuedTasks;
+    task();
+    return true;
+}
+
+void ThreadPool::workerLoop(std::size_t index) {
+    currentPool = this;
+    currentIndex = index;
+    
+    while (true) {
+        if (runOne(index)) {
+            continue;
+        }
+        
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeUp.wait(lock, [this] { return stopping || queuedTasks > 0; });
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::helpUntil(const std::function<bool()>& done) {
+    std::size_t self = getWorkerIndex();
+    while (!done()) {
+        if (!runOne(self)) {
+            std::this_thread::yield();
+        }
+    }
+}
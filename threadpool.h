@@ -0,0 +1,56 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool.
+// Every worker owns a queue: it pushes and pops tasks at the back, while
+// idle workers steal from the front of other queues. Threads waiting for a
+// result run queued tasks instead of blocking, so nested fork-join work
+// cannot deadlock the pool.
+class ThreadPool {
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+    
+    // One queue per worker plus one shared by threads outside the pool
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    
+    std::atomic<std::size_t> queuedTasks{0};
+    std::atomic<bool> stopping{false};
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    
+    bool runOne(std::size_t self);
+    void workerLoop(std::size_t index);
+
+public:
+    // Start the workers; zero means one per hardware thread
+    explicit ThreadPool(std::size_t threadCount = 0);
+    ~ThreadPool();
+    
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    
+    std::size_t getThreadCount() const { return threads.size(); }
+    
+    // Index of the calling worker, or getThreadCount() for threads outside the pool
+    std::size_t getWorkerIndex() const;
+    
+    // Queue a task; tasks must not throw
+    void submit(std::function<void()> task);
+    
+    // Run queued tasks on the calling thread until done() returns true
+    void helpUntil(const std::function<bool()>& done);
+};
@@ -0,0 +1,218 @@
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+namespace {
+    
+// Start of every trace file
+constexpr char traceMagic[8] = {'L', 'C', 'T', 'R', 'A', 'C', 'E', '1'};
+    
+// Layout of the file header
+struct TraceHeader {
+    char magic[8];
+    std::uint32_t recordSize;
+    std::uint32_t reserved;
+    std::uint64_t recordCount;          // 0 until the writer finished
+    std::uint64_t namesOffset;          // 0 until the writer finished
+};
+    
+// Records written per system call at most
+constexpr std::size_t batchSize = 4096;
+    
+}
+
+const char* getTraceKindName(TraceKind kind) {
+    switch (kind) {
+        case TraceKind::Begin: return "begin";
+        case TraceKind::Beta: return "beta";
+        case TraceKind::Delta: return "delta";
+        case TraceKind::Native: return "native";
+        case TraceKind::End: return "end";
+    }
+    return "unknown";
+}
+
+Tracer::Tracer(const std::string& path, std::size_t capacity) {
+    std::size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    slots = std::make_unique<Slot[]>(size);
+    mask = size - 1;
+    for (std::size_t i = 0; i < size; ++i) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        throw TraceError("Cannot create trace file " + path);
+    }
+    TraceHeader header{};
+    std::memcpy(header.magic, traceMagic, sizeof(traceMagic));
+    header.recordSize = sizeof(TraceRecord);
+    std::fwrite(&header, sizeof(header), 1, file);
+    
+    writer = std::thread([this] { run(); });
+}
+
+Tracer::~Tracer() {
+    stopping = true;
+    writer.join();
+    
+    // Name table, then the header again with the totals
+    TraceHeader header{};
+    std::memcpy(header.magic, traceMagic, sizeof(traceMagic));
+    header.recordSize = sizeof(TraceRecord);
+    header.recordCount = written;
+    header.namesOffset = sizeof(TraceHeader) + written * sizeof(TraceRecord);
+    
+    std::uint32_t count = static_cast<std::uint32_t>(std::count(mentioned.begin(), mentioned.end(), true));
+    std::fwrite(&count, sizeof(count), 1, file);
+    for (std::uint32_t symbol = 0; symbol < mentioned.size(); ++symbol) {
+        if (mentioned[symbol]) {
+            const std::string& name = getSymbolName(symbol);
+            auto length = static_cast<std::uint32_t>(name.size());
+            std::fwrite(&symbol, sizeof(symbol), 1, file);
+            std::fwrite(&length, sizeof(length), 1, file);
+            std::fwrite(name.data(), 1, name.size(), file);
+        }
+    }
+    
+    std::fseek(file, 0, SEEK_SET);
+    std::fwrite(&header, sizeof(header), 1, file);
+    std::fclose(file);
+}
+
+// Claim the next position and fill its slot. A slot whose sequence number
+// equals the position is free; one a lap behind is still waiting for the
+// writer, so the buffer is full.
+void Tracer::record(const TraceRecord& record) {
+    std::size_t position = enqueuePosition.load(std::memory_order_relaxed);
+    while (true) {
+        Slot& slot = slots[position & mask];
+        std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        auto difference = static_cast<std::ptrdiff_t>(sequence - position);
+        if (difference == 0) {
+            if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                slot.record = record;
+                slot.sequence.store(position + 1, std::memory_order_release);
+                return;
+            }
+        } else {
+            if (difference < 0) {
+                std::this_thread::yield();
+            }
+            position = enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Take the filled slots at the front of the buffer, in order
+bool Tracer::drain(std::vector<TraceRecord>& batch) {
+    batch.clear();
+    while (batch.size() < batchSize) {
+        Slot& slot = slots[dequeuePosition & mask];
+        if (slot.sequence.load(std::memory_order_acquire) != dequeuePosition + 1) {
+            break;
+        }
+        batch.push_back(slot.record);
+        slot.sequence.store(dequeuePosition + mask + 1, std::memory_order_release);
+        ++dequeuePosition;
+    }
+    return !batch.empty();
+}
+
+void Tracer::writeBatch(const std::vector<TraceRecord>& batch) {
+    for (const TraceRecord& record : batch) {
+        if (record.definition != 0) {
+            if (record.definition >= mentioned.size()) {
+                mentioned.resize(record.definition + 1, false);
+            }
+            mentioned[record.definition] = true;
+        }
+    }
+    std::fwrite(batch.data(), sizeof(TraceRecord), batch.size(), file);
+    std::fflush(file);
+    written += batch.size();
+}
+
+// Body of the writer thread: write batches until stopped and drained
+void Tracer::run() {
+    std::vector<TraceRecord> batch;
+    batch.reserve(batchSize);
+    while (true) {
+        bool stop = stopping;
+        if (drain(batch)) {
+            writeBatch(batch);
+        } else if (stop) {
+            break;
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+void Tracer::flush() {
+    std::size_t target = enqueuePosition.load();
+    while (written < target) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+const std::string& TraceFile::getName(std::uint32_t symbol) const {
+    static const std::string unknown = "?";
+    return symbol < names.size() && !names[symbol].empty() ? names[symbol] : unknown;
+}
+
+TraceFile readTrace(const std::string& path) {
+    std::ifstream input(path, std::ios::binary | std::ios::ate);
+    if (!input) {
+        throw TraceError("Cannot open trace file " + path);
+    }
+    auto fileSize = static_cast<std::uint64_t>(input.tellg());
+    input.seekg(0);
+    
+    TraceHeader header{};
+    if (!input.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, traceMagic, sizeof(traceMagic)) != 0 || header.recordSize != sizeof(TraceRecord)) {
+        throw TraceError("Not a trace file: " + path);
+    }
+    
+    std::uint64_t available = (fileSize - sizeof(header)) / sizeof(TraceRecord);
+    bool finished = header.namesOffset != 0;
+    if (finished && header.recordCount > available) {
+        throw TraceError("Trace file is truncated: " + path);
+    }
+    
+    TraceFile trace;
+    trace.records.resize(finished ? header.recordCount : available);
+    input.read(reinterpret_cast<char*>(trace.records.data()), trace.records.size() * sizeof(TraceRecord));
+    if (!finished) {
+        return trace;
+    }
+    
+    std::uint32_t count = 0;
+    input.seekg(header.namesOffset);
+    input.read(reinterpret_cast<char*>(&count), sizeof(count));
+    for (std::uint32_t i = 0; i < count && input; ++i) {
+        std::uint32_t symbol = 0;
+        std::uint32_t length = 0;
+        input.read(reinterpret_cast<char*>(&symbol), sizeof(symbol));
+        input.read(reinterpret_cast<char*>(&length), sizeof(length));
+        if (!input || length > fileSize || symbol > fileSize) {
+            break;
+        }
+        std::string name(length, '\0');
+        input.read(name.data(), length);
+        if (symbol >= trace.names.size()) {
+            trace.names.resize(symbol + 1);
+        }
+        trace.names[symbol] = std::move(name);
+    }
+    if (!input) {
+        throw TraceError("Trace file has a damaged name table: " + path);
+    }
+    return trace;
+}
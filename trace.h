@@ -0,0 +1,112 @@
+#pragma once
+
+#include "symbol.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Thrown when a trace file cannot be written or read
+class TraceError : public std::runtime_error {
+public:
+    explicit TraceError(const std::string& message) : std::runtime_error(message) {}
+};
+
+// Kinds of trace records
+enum class TraceKind : std::uint8_t {
+    Begin,          // An evaluation started; size is the size of the term evaluated
+    Beta,           // An abstraction applied; size is the size of the abstraction
+    Delta,          // A definition unfolded; size is the size of its body
+    Native,         // A native term unfolded or a primitive applied
+    End             // An evaluation finished or stopped; step is its number of steps
+};
+
+// Name of a kind of record in replays
+const char* getTraceKindName(TraceKind kind);
+
+// One record, written to the file as it is in memory
+struct TraceRecord {
+    std::uint64_t step;             // Steps of the evaluation so far, counting this one
+    std::uint32_t evaluation;       // Number of the evaluation in the trace, from one
+    std::uint32_t definition;       // Symbol of the definition unfolded, 0 if none
+    std::uint32_t size;             // Term nodes, as described for the kind; 0 if the engine has no term
+    std::uint32_t nodes;            // Term nodes allocated by the evaluation so far
+    TraceKind kind;
+    std::uint8_t reserved[7];
+};
+
+static_assert(sizeof(TraceRecord) == 32, "Trace records have a fixed size in the file");
+
+// Records reduction steps to a binary file. Any number of threads add
+// records to a bounded lock-free ring buffer, and a background thread
+// writes them out in batches, so recording a step costs a few atomic
+// operations and never a system call. When the buffer is full, recording
+// waits for the writer rather than losing records.
+//
+// The file starts with a header, followed by the records in the order they
+// were added and a table with the name of every definition they mention.
+class Tracer {
+private:
+    // Slot of the ring buffer. The sequence number tells whether the slot
+    // is free for the producer at a position or filled for the consumer.
+    struct Slot {
+        std::atomic<std::size_t> sequence;
+        TraceRecord record;
+    };
+    
+    std::unique_ptr<Slot[]> slots;
+    std::size_t mask;
+    alignas(64) std::atomic<std::size_t> enqueuePosition{0};
+    alignas(64) std::size_t dequeuePosition = 0;
+    
+    std::FILE* file;
+    std::thread writer;
+    std::atomic<bool> stopping{false};
+    std::atomic<std::size_t> written{0};
+    std::atomic<std::uint32_t> evaluations{0};
+    std::vector<bool> mentioned;            // Symbols used by the records written, for the name table
+    
+    bool drain(std::vector<TraceRecord>& batch);
+    void writeBatch(const std::vector<TraceRecord>& batch);
+    void run();
+
+public:
+    // Create a trace file; capacity is the number of records the buffer
+    // holds and is rounded up to a power of two
+    explicit Tracer(const std::string& path, std::size_t capacity = 1 << 16);
+    
+    // Writes the remaining records and the name table, then closes the file
+    ~Tracer();
+    
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+    
+    // Number for a new evaluation, from one
+    std::uint32_t nextEvaluation() { return ++evaluations; }
+    
+    // Add a record. Safe to call from any thread.
+    void record(const TraceRecord& record);
+    
+    // Wait until every record added so far is written
+    void flush();
+    
+    // Number of records written to the file so far
+    std::size_t getWrittenCount() const { return written; }
+};
+
+// Contents of a trace file
+struct TraceFile {
+    std::vector<TraceRecord> records;
+    std::vector<std::string> names;         // Indexed by the symbols in the records; empty if unused
+    
+    const std::string& getName(std::uint32_t symbol) const;
+};
+
+// Read a whole trace file. A trace whose writer did not finish is read up
+// to its last complete record, without names.
+TraceFile readTrace(const std::string& path);
@@ -0,0 +1,134 @@
+// tracetool.cpp
+// Reads trace files written by lambda_calculus --trace or :trace. The
+// summary gives the steps of every evaluation by kind and the definitions
+// unfolded most; the replay prints every record as a line of text.
+#include "trace.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Totals of one evaluation in a trace
+struct EvaluationSummary {
+    std::uint64_t steps = 0;
+    std::uint64_t beta = 0;
+    std::uint64_t delta = 0;
+    std::uint64_t native = 0;
+    std::uint32_t initialSize = 0;
+    std::uint32_t peakSize = 0;
+    std::uint32_t nodes = 0;
+    bool finished = false;
+};
+
+static void printUsage() {
+    std::cerr << "Usage: lambda_trace [summary|replay] [--top N] FILE" << std::endl;
+    std::cerr << "  summary (the default) prints the steps of every evaluation and the" << std::endl;
+    std::cerr << "  N definitions unfolded most (10 by default); replay prints every record." << std::endl;
+}
+
+static void replay(const TraceFile& trace) {
+    std::cout << "evaluation step kind definition size nodes" << std::endl;
+    for (const TraceRecord& record : trace.records) {
+        std::cout << record.evaluation << ' ' << record.step << ' ' << getTraceKindName(record.kind) << ' '
+                  << (record.definition ? trace.getName(record.definition) : "-") << ' '
+                  << record.size << ' ' << record.nodes << std::endl;
+    }
+}
+
+static void summarize(const TraceFile& trace, std::size_t top) {
+    // Evaluations of a batch run are interleaved, so they are kept by number
+    std::map<std::uint32_t, EvaluationSummary> evaluations;
+    std::map<std::uint32_t, std::uint64_t> unfolds;
+    
+    for (const TraceRecord& record : trace.records) {
+        EvaluationSummary& summary = evaluations[record.evaluation];
+        summary.nodes = std::max(summary.nodes, record.nodes);
+        switch (record.kind) {
+            case TraceKind::Begin:
+                summary.initialSize = record.size;
+                summary.peakSize = std::max(summary.peakSize, record.size);
+                break;
+            case TraceKind::Beta:
+                ++summary.beta;
+                summary.peakSize = std::max(summary.peakSize, record.size);
+                break;
+            case TraceKind::Delta:
+                ++summary.delta;
+                ++unfolds[record.definition];
+                break;
+            case TraceKind::Native:
+                ++summary.native;
+                break;
+            case TraceKind::End:
+                summary.steps = record.step;
+                summary.finished = true;
+                break;
+        }
+    }
+    
+    std::cout << std::left << std::setw(12) << "Evaluation" << std::right << std::setw(12) << "Steps"
+              << std::setw(12) << "Beta" << std::setw(12) << "Delta" << std::setw(12) << "Native"
+              << std::setw(12) << "Size" << std::setw(12) << "Max redex" << std::setw(12) << "Nodes" << std::endl;
+    for (const auto& [number, summary] : evaluations) {
+        std::string steps = summary.finished ? std::to_string(summary.steps) : "unfinished";
+        std::cout << std::left << std::setw(12) << number << std::right << std::setw(12) << steps
+                  << std::setw(12) << summary.beta << std::setw(12) << summary.delta << std::setw(12) << summary.native
+                  << std::setw(12) << summary.initialSize << std::setw(12) << summary.peakSize
+                  << std::setw(12) << summary.nodes << std::endl;
+    }
+    
+    std::vector<std::pair<std::uint32_t, std::uint64_t>> ranked(unfolds.begin(), unfolds.end());
+    std::sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    if (ranked.size() > top) {
+        ranked.resize(top);
+    }
+    if (!ranked.empty()) {
+        std::cout << std::endl << std::left << std::setw(24) << "Definition" << std::right << std::setw(12) << "Unfolded" << std::endl;
+        for (const auto& [symbol, count] : ranked) {
+            std::cout << std::left << std::setw(24) << (symbol ? trace.getName(symbol) : "-")
+                      << std::right << std::setw(12) << count << std::endl;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string mode = "summary";
+    std::size_t top = 10;
+    std::string path;
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument == "summary" || argument == "replay") {
+            mode = argument;
+        } else if (argument == "--top" && i + 1 < argc) {
+            top = static_cast<std::size_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (path.empty() && !argument.empty() && argument[0] != '-') {
+            path = argument;
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+    if (path.empty()) {
+        printUsage();
+        return 1;
+    }
+    
+    try {
+        TraceFile trace = readTrace(path);
+        if (mode == "replay") {
+            replay(trace);
+        } else {
+            summarize(trace, top);
+        }
+    } catch (const TraceError& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
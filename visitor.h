@@ -1,10 +1,12 @@
 #pragma once
 
 // Forward declarations
+class Expression;
 class Variable;
 class Abstraction;
 class Application;
 class NamedReference;
+class IntegerLiteral;
 
 // Visitor interface
 class IVisitor {
@@ -16,4 +18,35 @@ public:
     virtual void visit(Abstraction& abstraction) = 0;
     virtual void visit(Application& application) = 0;
     virtual void visit(NamedReference& reference) = 0;
-};
\ No newline at end of file
+    virtual void visit(IntegerLiteral& literal) = 0;
+};
+
+// Hooks of an iterative depth-first traversal, for operations that need
+// the whole tree rather than one node. The hooks of a node are called in
+// order: enter, then the children (the function before the argument), then
+// leave. An enter hook returning false skips the children and the leave hook.
+class ITraversal {
+public:
+    virtual ~ITraversal() = default;
+    
+    // Leaves
+    virtual void visit(const Variable&) {}
+    virtual void visit(const NamedReference&) {}
+    virtual void visit(const IntegerLiteral&) {}
+    
+    // Before the children
+    virtual bool enter(const Abstraction&) { return true; }
+    virtual bool enter(const Application&) { return true; }
+    
+    // Between the function and the argument of an application
+    virtual void separate(const Application&) {}
+    
+    // After the children
+    virtual void leave(const Abstraction&) {}
+    virtual void leave(const Application&) {}
+};
+
+// Walk an expression, calling the hooks of a traversal. Pending nodes are
+// kept on an explicit stack, so the depth of the expression is bounded only
+// by memory and never by the native stack.
+void traverse(const Expression& root, ITraversal& traversal);
\ No newline at end of file
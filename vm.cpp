@@ -0,0 +1,244 @@
+#include "vm.h"
+
+enum class ValueKind {
+    Closure,    // Compiled lambda with its scope
+    Neutral     // Variable or free name applied to arguments
+};
+
+struct VirtualMachine::Value {
+    ValueKind kind;
+    std::uint32_t function;     // Closure: index of the compiled lambda
+    const Scope* scope;         // Closure
+    TermPtr head;               // Neutral: the free name, or null for a variable
+    std::size_t level;          // Neutral variable: bound by the level-th lambda entered while reading back
+    Thunk* argument;            // Neutral: last argument, or null
+    const Value* applied;       // Neutral: the value the last argument is applied to
+};
+
+// Block evaluated on first use, then overwritten with its value
+struct VirtualMachine::Thunk {
+    std::uint32_t entry;
+    const Scope* scope;
+    const Value* value;
+    Symbol definition;          // Definition whose block this is, or 0; entering it counts as a delta step
+};
+
+struct VirtualMachine::Scope {
+    Thunk* thunk;
+    const Scope* next;
+};
+
+// Block waiting for the value of a thunk it forced
+struct VirtualMachine::Frame {
+    Thunk* thunk;
+    std::uint32_t pc;
+    const Scope* scope;
+    std::size_t pending;
+};
+
+VirtualMachine::VirtualMachine(IReductionContext& context, const Program& program)
+    : context(context), program(program), machineNodes(context) {}
+
+VirtualMachine::~VirtualMachine() = default;
+
+VirtualMachine::Thunk* VirtualMachine::lookup(const Scope* scope, std::uint32_t index) const {
+    for (std::uint32_t i = 0; i < index; ++i) {
+        scope = scope->next;
+    }
+    return scope->thunk;
+}
+
+VirtualMachine::Thunk* VirtualMachine::global(Symbol name) {
+    if (name >= globals.size()) {
+        globals.resize(name + 1, nullptr);
+    }
+    if (!globals[name]) {
+        std::uint32_t entry;
+        if (program.getDefinition(name, entry)) {
+            globals[name] = values.create<Thunk>(Thunk{entry, nullptr, nullptr, name});
+        } else {
+            // An undefined name stays a free reference
+            auto reference = values.create<Value>(Value{ValueKind::Neutral, 0, nullptr, context.getArena().makeReference(name), 0, nullptr, nullptr});
+            globals[name] = values.create<Thunk>(Thunk{0, nullptr, reference, 0});
+        }
+    }
+    return globals[name];
+}
+
+// Run a block until it returns a value. The blocks of the thunks it forces
+// run in the same loop, with their return points on the frame stack.
+const VirtualMachine::Value* VirtualMachine::execute(std::uint32_t entry, const Scope* initialScope) {
+    const Instruction* code = program.getCode();
+    std::size_t base = frames.size();
+    
+    // Registers: the next instruction, the scope of the running block, the
+    // number of arguments below the block's own that its value is applied
+    // to, and the value loaded last
+    std::uint32_t pc = entry;
+    const Scope* scope = initialScope;
+    std::size_t pending = 0;
+    const Value* value = nullptr;
+    
+    while (true) {
+        Instruction instruction = code[pc++];
+        Thunk* forced = nullptr;
+        std::size_t count = pending;
+        
+        switch (instruction.opcode) {
+            case Opcode::PushVariable:
+                arguments.push_back(lookup(scope, instruction.operand));
+                continue;
+            case Opcode::PushThunk:
+                arguments.push_back(values.create<Thunk>(Thunk{instruction.operand, scope, nullptr, 0}));
+                continue;
+            case Opcode::PushClosure: {
+                auto closure = values.create<Value>(Value{ValueKind::Closure, instruction.operand, scope, nullptr, 0, nullptr, nullptr});
+                arguments.push_back(values.create<Thunk>(Thunk{0, nullptr, closure, 0}));
+                continue;
+            }
+            case Opcode::PushGlobal:
+                arguments.push_back(global(instruction.operand));
+                continue;
+            case Opcode::Access:
+                forced = lookup(scope, instruction.operand);
+                break;
+            case Opcode::Global:
+                forced = global(instruction.operand);
+                break;
+            case Opcode::Closure:
+                value = values.create<Value>(Value{ValueKind::Closure, instruction.operand, scope, nullptr, 0, nullptr, nullptr});
+                continue;
+            case Opcode::Free:
+                value = values.create<Value>(Value{ValueKind::Neutral, 0, nullptr, context.getArena().makeFree(instruction.operand), 0, nullptr, nullptr});
+                continue;
+            case Opcode::TailApply:
+                count += instruction.operand;
+                break;
+            case Opcode::Return:
+                break;
+        }
+        
+        if (forced) {
+            if (forced->value) {
+                value = forced->value;
+                continue;
+            }
+            // Run the thunk's block and come back to the next instruction
+            if (forced->definition) {
+                context.countStep(StepKind::Delta, forced->definition);
+            }
+            frames.push_back(Frame{forced, pc, scope, pending});
+            pc = forced->entry;
+            scope = forced->scope;
+            pending = 0;
+            continue;
+        }
+        
+        // Apply the value to the arguments on top of the stack. Neutral
+        // applications take no step, so the machine is charged here.
+        machineNodes.update(values.getAllocationCount() + arguments.size() + frames.size());
+        if (count > 0 && value->kind == ValueKind::Closure) {
+            // Enter the body; its value is applied to the remaining arguments
+            context.countStep(StepKind::Beta);
+            scope = values.create<Scope>(Scope{arguments.back(), value->scope});
+            arguments.pop_back();
+            pc = program.getFunction(value->function).entry;
+            pending = count - 1;
+            continue;
+        }
+        for (; count > 0; --count) {
+            value = values.create<Value>(Value{ValueKind::Neutral, 0, nullptr, value->head, value->level, arguments.back(), value});
+            arguments.pop_back();
+        }
+        
+        // Return the value, updating the thunk that was forced for it
+        if (frames.size() == base) {
+            return value;
+        }
+        Frame frame = frames.back();
+        frames.pop_back();
+        frame.thunk->value = value;
+        pc = frame.pc;
+        scope = frame.scope;
+        pending = frame.pending;
+    }
+}
+
+// Read a value back as a term. Uses an explicit stack, like the machine.
+TermPtr VirtualMachine::readBack(const Value* start) {
+    TermArena& terms = context.getArena();
+    
+    enum class FrameKind {
+        ReadBody,           // Wrap the body read back in a lambda
+        ReadArgument,       // Read back the next argument of a neutral value
+        BuildApplication    // Apply the function read back to the argument read back
+    };
+    struct ReadFrame {
+        FrameKind kind;
+        Symbol hint;        // ReadBody
+        TermPtr term;       // BuildApplication: the function
+        Thunk* argument;    // ReadArgument
+    };
+    
+    std::vector<ReadFrame> stack;
+    std::size_t depth = 0;
+    const Value* value = start;
+    
+    while (true) {
+        machineNodes.update(values.getAllocationCount() + stack.size());
+        if (value->kind == ValueKind::Closure) {
+            // Enter the body with a fresh variable for the parameter
+            const Function& function = program.getFunction(value->function);
+            auto variable = values.create<Value>(Value{ValueKind::Neutral, 0, nullptr, nullptr, depth++, nullptr, nullptr});
+            auto argument = values.create<Thunk>(Thunk{0, nullptr, variable, 0});
+            stack.push_back({FrameKind::ReadBody, function.hint, nullptr, nullptr});
+            value = execute(function.entry, values.create<Scope>(Scope{argument, value->scope}));
+            continue;
+        }
+        
+        // Queue the arguments, first argument on top, then read back the head
+        for (; value->argument; value = value->applied) {
+            stack.push_back({FrameKind::ReadArgument, 0, nullptr, value->argument});
+        }
+        TermPtr term = value->head ? value->head : terms.makeBound(depth - 1 - value->level);
+        
+        // Pass the term outwards until another value has to be read back
+        value = nullptr;
+        while (!value) {
+            if (stack.empty()) {
+                return term;
+            }
+            
+            ReadFrame frame = stack.back();
+            stack.pop_back();
+            
+            switch (frame.kind) {
+                case FrameKind::ReadBody:
+                    term = terms.makeAbstraction(frame.hint, term);
+                    --depth;
+                    break;
+                case FrameKind::ReadArgument: {
+                    stack.push_back({FrameKind::BuildApplication, 0, term, nullptr});
+                    Thunk* thunk = frame.argument;
+                    if (!thunk->value) {
+                        if (thunk->definition) {
+                            context.countStep(StepKind::Delta, thunk->definition);
+                        }
+                        thunk->value = execute(thunk->entry, thunk->scope);
+                    }
+                    value = thunk->value;
+                    break;
+                }
+                case FrameKind::BuildApplication:
+                    term = terms.makeApplication(frame.term, term);
+                    break;
+            }
+        }
+    }
+}
+
+TermPtr VirtualMachine::normalize(std::uint32_t entry) {
+    TermPtr result = readBack(execute(entry, nullptr));
+    context.countMachineNodes(values.getAllocationCount());
+    return result;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "bytecode.h"
+#include "reduction.h"
+#include "arena.h"
+#include <vector>
+
+// Call-by-need evaluation of compiled bytecode.
+// A scope is a linked list of thunks, innermost binding first, and each
+// thunk is a block of code with the scope it runs in. Forcing a thunk saves
+// the return point on an explicit stack and overwrites the thunk with its
+// value when the block returns, so every argument is evaluated at most once
+// and deep evaluations use no native stack. Values are closures or neutral
+// terms; the value of the whole expression is read back into a normal form
+// by applying closures to fresh variables, as in normalization by evaluation.
+class VirtualMachine {
+private:
+    struct Value;
+    struct Thunk;
+    struct Scope;
+    struct Frame;
+    
+    IReductionContext& context;
+    const Program& program;
+    
+    // Values, thunks and scopes are only needed until the result is read back
+    Arena values;
+    MachineNodeCounter machineNodes;
+    
+    // Shared thunk of each definition, by symbol, created on first use
+    std::vector<Thunk*> globals;
+    
+    // Arguments waiting to be applied, first argument on top
+    std::vector<Thunk*> arguments;
+    
+    // Blocks to return to, with the thunks their values update
+    std::vector<Frame> frames;
+    
+    Thunk* lookup(const Scope* scope, std::uint32_t index) const;
+    Thunk* global(Symbol name);
+    const Value* execute(std::uint32_t entry, const Scope* scope);
+    TermPtr readBack(const Value* value);
+
+public:
+    VirtualMachine(IReductionContext& context, const Program& program);
+    ~VirtualMachine();
+    
+    // Evaluate a compiled expression to normal form
+    TermPtr normalize(std::uint32_t entry);
+};